@@ -0,0 +1,333 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <array>
+
+#include "microcode.h"
+#include "simulator.h"
+
+namespace
+{
+    enum class alu_family : std::size_t
+    {
+        add, sub, and_, or_, not_, shl, shr,
+    };
+    
+    constexpr const auto alu_families = std::size_t{ 7 };
+    
+    // one ALU row of the table: dest <- dest op (src register, or Q1 when src is npos)
+    struct alu_case
+    {
+        std::uint8_t opcode;
+        alu_family family;
+        std::size_t dest, src;
+    };
+    
+    constexpr const auto alu_imm = static_cast<std::size_t>(-1);
+    
+    constexpr auto alu_cases(void) noexcept
+    {
+        enum : std::size_t { A, B, C, D };
+        
+        return std::to_array<alu_case>(
+        {
+#define ALUR(x, y) { ADC_##x##_##y, alu_family::add, x, y }, { SBB_##x##_##y, alu_family::sub, x, y }, \
+                   { AND_##x##_##y, alu_family::and_, x, y }, { LOR_##x##_##y, alu_family::or_, x, y },
+#define ALUI(x) { ADC_##x##_IMM, alu_family::add, x, alu_imm }, { SBB_##x##_IMM, alu_family::sub, x, alu_imm }, \
+                { AND_##x##_IMM, alu_family::and_, x, alu_imm }, { LOR_##x##_IMM, alu_family::or_, x, alu_imm }, \
+                { ROL_##x##_IMM, alu_family::shl, x, alu_imm }, { ROR_##x##_IMM, alu_family::shr, x, alu_imm }, \
+                { NOT_##x, alu_family::not_, x, x },
+            ALUR(A, B) ALUR(A, C) ALUR(A, D)
+            ALUR(B, A) ALUR(B, C) ALUR(B, D)
+            ALUR(C, A) ALUR(C, B) ALUR(C, D)
+            ALUR(D, A) ALUR(D, B) ALUR(D, C)
+            
+            ALUI(A) ALUI(B) ALUI(C) ALUI(D)
+#undef ALUR
+#undef ALUI
+        });
+    }
+    
+    // expected result | C << 8 | Z << 9 for every a << 8 | b, per family and carry-in
+    using alu_expectation = std::array<std::uint16_t, 0x10000>;
+    
+    // each family is its own straight-line loop over 16-bit lanes so the compiler emits vector code for it
+    void alu_reference(alu_family family, unsigned int carry, alu_expectation& out) noexcept
+    {
+        const auto kernel = [&](auto&& op)
+        {
+            for (auto i = 0u; i < 0x10000; ++i)
+            {
+                const auto wide = static_cast<std::uint16_t>(op(i >> 8, i & 0xFF) & 0x1FF);
+                out[i] = static_cast<std::uint16_t>(wide | (((wide & 0xFF) == 0) << 9));
+            }
+        };
+        
+        switch (family)
+        {
+            case alu_family::add:  kernel([=](unsigned int a, unsigned int b) { return a + b + carry; }); break;
+            case alu_family::sub:  kernel([=](unsigned int a, unsigned int b) { return (a - b - carry) & 0x1FF; }); break;
+            case alu_family::and_: kernel([ ](unsigned int a, unsigned int b) { return a & b; }); break;
+            case alu_family::or_:  kernel([ ](unsigned int a, unsigned int b) { return a | b; }); break;
+            case alu_family::not_: kernel([ ](unsigned int a, unsigned int)   { return ~a & 0xFF; }); break;
+            case alu_family::shl:  kernel([ ](unsigned int a, unsigned int b) { return ((a * 0x101u) >> (8 - (b & 7))) & 0xFF; }); break;
+            case alu_family::shr:  kernel([ ](unsigned int a, unsigned int b) { return ((a * 0x101u) >> (b & 7)) & 0xFF; }); break;
+        }
+    }
+    
+    // the datapath an ALU row touches, one operand pair per lane
+    struct alu_lanes
+    {
+        using lane = std::array<std::uint8_t, 0x10000>;
+        
+        std::array<lane, 4> registers;
+        lane f, q1, alu_a, alu_b, alu_out, alu_flags;
+        lane result, flags; //what the ALU computes from this step's inputs
+    };
+    
+    // control signals an ALU row may use and still be swept in lanes, a row with any other goes through the simulator
+    constexpr const auto alu_lane_signals = LEN(3) | PC_OE | PC_INI | LSU_RE | OUT_Q1 | RF_AO | RF_BO | RF_CO | RF_DO |
+                                            RF_AI | RF_BI | RF_CI | RF_DI | RF_FI | ALU_WA | ALU_WB | ALU_OE | ALU_HOLD |
+                                            ALU_ADD | ALU_SUB | ALU_AND | ALU_OR | ALU_NOT | ALU_SHL | ALU_SHR;
+    
+    template<µcode_type op>
+    void alu_lane_kernel(alu_lanes& lanes, std::size_t count) noexcept
+    {
+        for (auto i = std::size_t{ 0 }; i < count; ++i)
+        {
+            const auto [result, flags] = alu_function(op, lanes.alu_a[i], lanes.alu_b[i], lanes.f[i] & FLAG_C);
+            
+            lanes.result[i] = result;
+            lanes.flags[i] = flags;
+        }
+    }
+    
+    // the ALU with this step's operation fixed, so each kernel is a straight loop the compiler vectorises
+    inline void alu_lane_function(µcode_type µop, alu_lanes& lanes, std::size_t count) noexcept
+    {
+        switch (µop & (ALU_ADD | ALU_SUB | ALU_AND | ALU_OR | ALU_NOT | ALU_SHL | ALU_SHR))
+        {
+            case ALU_ADD: alu_lane_kernel<ALU_ADD>(lanes, count); break;
+            case ALU_SUB: alu_lane_kernel<ALU_SUB>(lanes, count); break;
+            case ALU_AND: alu_lane_kernel<ALU_AND>(lanes, count); break;
+            case ALU_OR:  alu_lane_kernel<ALU_OR>(lanes, count); break;
+            case ALU_NOT: alu_lane_kernel<ALU_NOT>(lanes, count); break;
+            case ALU_SHL: alu_lane_kernel<ALU_SHL>(lanes, count); break;
+            case ALU_SHR: alu_lane_kernel<ALU_SHR>(lanes, count); break;
+            
+            // no or several operations, which the priority in alu_function() settles
+            default:
+                for (auto i = std::size_t{ 0 }; i < count; ++i)
+                {
+                    const auto [result, flags] = alu_function(µop, lanes.alu_a[i], lanes.alu_b[i], lanes.f[i] & FLAG_C);
+                    
+                    lanes.result[i] = result;
+                    lanes.flags[i] = flags;
+                }
+                break;
+        }
+    }
+    
+    // one control word applied across the lanes the way simulator::execute() applies it to one machine; the PC is the same
+    // in every lane, and of the bytes it can address only the immediate behind the opcode differs between them
+    template<typename layout>
+    void alu_lane_step(µcode_type µop, alu_lanes& lanes, std::size_t count, std::uint16_t& pc, std::uint8_t opcode, bool immediate) noexcept
+    {
+        if (layout::latched_alu ? (µop & ALU_HOLD) : (µop & (ALU_OE | RF_FI)))
+        {
+            alu_lane_function(µop, lanes, count);
+        }
+        
+        const auto mask = [&](µcode_type signal) { return static_cast<std::uint8_t>((µop & signal) ? 0xFF : 0x00); };
+        
+        const auto a_out = mask(RF_AO), b_out = mask(RF_BO), c_out = mask(RF_CO), d_out = mask(RF_DO), q1_out = mask(OUT_Q1);
+        const auto alu_oe = mask(ALU_OE), latched = static_cast<std::uint8_t>(layout::latched_alu ? 0xFF : 0x00);
+        const auto a_in = mask(RF_AI), b_in = mask(RF_BI), c_in = mask(RF_CI), d_in = mask(RF_DI), f_in = mask(RF_FI);
+        const auto wa = mask(ALU_WA), wb = mask(ALU_WB), hold = static_cast<std::uint8_t>(latched & mask(ALU_HOLD));
+        
+        // the first board loads its immediate from ROM behind the opcode, the byte Q1 holds everywhere else
+        const auto address = (µop & PC_OE) ? pc : std::uint16_t{ 0 };
+        const auto load = static_cast<std::uint8_t>((µop & LSU_RE) && address == 0 ? opcode : 0);
+        const auto load_lane = static_cast<std::uint8_t>((µop & LSU_RE) && address == 1 && immediate ? 0xFF : 0x00);
+        
+        auto& [a, b, c, d] = lanes.registers;
+        
+        for (auto i = std::size_t{ 0 }; i < count; ++i)
+        {
+            const auto out = static_cast<std::uint8_t>((latched & lanes.alu_out[i]) | (~latched & lanes.result[i]));
+            const auto out_flags = static_cast<std::uint8_t>((latched & lanes.alu_flags[i]) | (~latched & lanes.flags[i]));
+            
+            const auto data = static_cast<std::uint8_t>((a[i] & a_out) | (b[i] & b_out) | (c[i] & c_out) | (d[i] & d_out) | (out & alu_oe) |
+                                                        (lanes.q1[i] & (q1_out | load_lane)) | load);
+            
+            a[i] = static_cast<std::uint8_t>((a[i] & ~a_in) | (data & a_in));
+            b[i] = static_cast<std::uint8_t>((b[i] & ~b_in) | (data & b_in));
+            c[i] = static_cast<std::uint8_t>((c[i] & ~c_in) | (data & c_in));
+            d[i] = static_cast<std::uint8_t>((d[i] & ~d_in) | (data & d_in));
+            
+            const auto f = static_cast<std::uint8_t>((lanes.f[i] & ~(FLAG_C | FLAG_Z)) | out_flags);
+            lanes.f[i] = static_cast<std::uint8_t>((lanes.f[i] & ~f_in) | (f & f_in));
+            
+            lanes.alu_a[i] = static_cast<std::uint8_t>((lanes.alu_a[i] & ~wa) | (data & wa));
+            lanes.alu_b[i] = static_cast<std::uint8_t>((lanes.alu_b[i] & ~wb) | (data & wb));
+            lanes.alu_out[i] = static_cast<std::uint8_t>((lanes.alu_out[i] & ~hold) | (lanes.result[i] & hold));
+            lanes.alu_flags[i] = static_cast<std::uint8_t>((lanes.alu_flags[i] & ~hold) | (lanes.flags[i] & hold));
+        }
+        
+        if (µop & PC_INI) pc = static_cast<std::uint16_t>(pc + (µop >> 62));
+    }
+    
+    // sweeps every ALU row for all 256 x 256 operands and both carry-ins: a row is decoded from the table once and its
+    // control words are applied to every operand pair side by side, rows using anything else run through the simulator
+    template<trap_encoding encoding, typename layout>
+    int run_alu_check(unsigned int threads) noexcept
+    {
+        static constexpr auto& µcode = decoded_µcode<encoding, layout>;
+        static constexpr auto cases = alu_cases();
+        static constexpr auto registers = std::to_array({ &machine_state::a, &machine_state::b, &machine_state::c, &machine_state::d });
+        
+        // bits the ALU must leave alone in F
+        static constexpr auto spare_flags = static_cast<std::uint8_t>(0xA4);
+        
+        const auto start = std::chrono::steady_clock::now();
+        
+        auto expected = std::vector<alu_expectation>(alu_families * 2);
+        
+        for (auto family = std::size_t{ 0 }; family < alu_families; ++family)
+        {
+            alu_reference(static_cast<alu_family>(family), 0, expected[family * 2]);
+            alu_reference(static_cast<alu_family>(family), 1, expected[family * 2 + 1]);
+        }
+        
+        auto next = std::atomic<std::size_t>{ 0 };
+        auto failures = std::atomic<std::size_t>{ 0 };
+        auto laned = std::atomic<std::size_t>{ 0 };
+        
+        const auto check = [&](const alu_case& test, unsigned int operands, unsigned int carry, std::uint8_t got, std::uint8_t got_flags)
+        {
+            const auto want = expected[static_cast<std::size_t>(test.family) * 2 + carry][operands];
+            const auto flags = static_cast<std::uint8_t>(spare_flags | ((want & 0x100) ? FLAG_C : 0) | ((want & 0x200) ? FLAG_Z : 0));
+            
+            if ((got != static_cast<std::uint8_t>(want) || got_flags != flags) && failures++ < 16)
+            {
+                std::fprintf(stdout, "[ALU] opcode %02X a=%02X b=%02X carry=%u: got %02X f=%02X, expected %02X f=%02X\n",
+                             test.opcode, operands >> 8, operands & 0xFF, carry, got, got_flags, static_cast<std::uint8_t>(want), flags);
+            }
+        };
+        
+        const auto worker = [&]
+        {
+            auto sim = std::make_unique<simulator<encoding, layout>>(µcode);
+            auto lanes = std::make_unique<alu_lanes>();
+            auto& state = sim->state;
+            
+            for (auto index = next++; index < cases.size(); index = next++)
+            {
+                const auto& test = cases[index];
+                const auto sweep = (test.family == alu_family::not_) ? 0x100u : 0x10000u, stride = 0x10000u / sweep;
+                
+                // the row as the sequencer presents it after the fetch, with the flags at the fetch clear
+                auto steps = std::vector<µcode_type>{};
+                auto fits = layout::separate_address_bus && !layout::fetch_overlap;
+                
+                for (auto step = layout::fetch_steps; step < layout::width && µcode[test.opcode][step] != 0; ++step)
+                {
+                    steps.push_back(expand_word<layout>(µcode[test.opcode][step]));
+                    fits &= (steps.back() & ~alu_lane_signals) == 0;
+                }
+                
+                laned += fits;
+                sim->memory[0] = test.opcode;
+                
+                for (auto carry = 0u; carry < 2; ++carry)
+                {
+                    if (fits)
+                    {
+                        auto& registers = lanes->registers;
+                        
+                        for (auto i = 0u; i < sweep; ++i)
+                        {
+                            const auto a = static_cast<std::uint8_t>((i * stride) >> 8), b = static_cast<std::uint8_t>(i * stride);
+                            
+                            registers[0][i] = registers[1][i] = registers[2][i] = registers[3][i] = 0;
+                            registers[test.dest][i] = a;
+                            
+                            if (test.src != alu_imm && test.src != test.dest) registers[test.src][i] = b;
+                            
+                            lanes->q1[i] = (test.src == alu_imm) ? b : 0;
+                            lanes->f[i] = static_cast<std::uint8_t>(spare_flags | (carry ? FLAG_C : 0));
+                            lanes->alu_a[i] = lanes->alu_b[i] = lanes->alu_out[i] = lanes->alu_flags[i] = 0;
+                        }
+                        
+                        auto pc = std::uint16_t{ 0 };
+                        
+                        for (const auto µop : steps)
+                        {
+                            alu_lane_step<layout>(µop, *lanes, sweep, pc, test.opcode, test.src == alu_imm);
+                        }
+                        
+                        for (auto i = 0u; i < sweep; ++i)
+                        {
+                            check(test, i * stride, carry, registers[test.dest][i], lanes->f[i]);
+                        }
+                        
+                        continue;
+                    }
+                    
+                    for (auto i = 0u; i < 0x10000; i += stride)
+                    {
+                        const auto a = static_cast<std::uint8_t>(i >> 8), b = static_cast<std::uint8_t>(i);
+                        
+                        state = machine_state{};
+                        state.*registers[test.dest] = a;
+                        
+                        // the first board reads immediates from ROM behind the opcode rather than from Q1
+                        if (test.src == alu_imm) state.q1 = sim->memory[1] = b;
+                        else if (test.src != test.dest) state.*registers[test.src] = b;
+                        
+                        state.f = static_cast<std::uint8_t>(spare_flags | (carry ? FLAG_C : 0));
+                        state.ir = test.opcode;
+                        state.step = layout::fetch_steps;
+                        
+                        do
+                        {
+                            sim->clock();
+                        }
+                        while (state.step != 0);
+                        
+                        check(test, i, carry, state.*registers[test.dest], state.f);
+                    }
+                }
+            }
+        };
+        
+        const auto workers = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+        auto pool = std::vector<std::thread>{};
+        
+        for (auto i = 0u; i < workers; ++i)
+        {
+            pool.emplace_back(worker);
+        }
+        
+        for (auto& thread : pool)
+        {
+            thread.join();
+        }
+        
+        const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        std::fprintf(stdout, "[ALU] %zu rows x 256 x 256 x 2 swept in %.2f s on %u threads, %zu of them in lanes, %zu mismatches\n",
+                     cases.size(), seconds, workers, laned.load(), failures.load());
+        
+        return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <optional>
+#include <vector>
+
+#include "opcode.h"
+
+namespace
+{
+    // a program image under construction, jumps and calls may name labels that are only bound later
+    class assembler
+    {
+    public:
+        struct label
+        {
+            std::size_t index;
+        };
+        
+        explicit assembler(std::uint16_t origin = 0) noexcept : origin(origin) {}
+        
+        label make_label(void)
+        {
+            addresses.push_back(std::nullopt);
+            return label{ addresses.size() - 1 };
+        }
+        
+        void bind(label target) noexcept
+        {
+            addresses[target.index] = here();
+        }
+        
+        std::uint16_t here(void) const noexcept
+        {
+            return static_cast<std::uint16_t>(origin + code.size());
+        }
+        
+        assembler& emit(std::uint8_t opcode)
+        {
+            code.push_back(opcode);
+            return *this;
+        }
+        
+        assembler& emit(std::uint8_t opcode, std::uint8_t operand)
+        {
+            code.insert(code.end(), { opcode, operand });
+            return *this;
+        }
+        
+        // 16-bit operands are little-endian, like every address the microcode latches
+        assembler& emit(std::uint8_t opcode, label target)
+        {
+            code.push_back(opcode);
+            fixups.push_back({ code.size(), target });
+            code.insert(code.end(), { 0, 0 });
+            return *this;
+        }
+        
+        assembler& emit_absolute(std::uint8_t opcode, std::uint16_t address)
+        {
+            code.insert(code.end(), { opcode, static_cast<std::uint8_t>(address), static_cast<std::uint8_t>(address >> 8) });
+            return *this;
+        }
+        
+        // PUSH_IP saves its own address and POP_IP resumes one past it, so the callee steps the saved address over the JMP
+        assembler& call(label target)
+        {
+            return emit(PUSH_IP).emit(JMP_MEM, target);
+        }
+        
+        // the image from the origin on, or nothing if a label was used but never bound
+        std::optional<std::vector<std::uint8_t>> link(void) const
+        {
+            auto image = code;
+            
+            for (const auto& [offset, target] : fixups)
+            {
+                const auto address = addresses[target.index];
+                
+                if (!address)
+                {
+                    return std::nullopt;
+                }
+                
+                image[offset] = static_cast<std::uint8_t>(*address);
+                image[offset + 1] = static_cast<std::uint8_t>(*address >> 8);
+            }
+            
+            return image;
+        }
+    
+    private:
+        struct fixup
+        {
+            std::size_t offset;
+            label target;
+        };
+        
+        std::uint16_t origin;
+        std::vector<std::uint8_t> code{};
+        std::vector<std::optional<std::uint16_t>> addresses{};
+        std::vector<fixup> fixups{};
+    };
+}
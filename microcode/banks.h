@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <array>
+#include <memory>
+
+namespace
+{
+    // data memory behind the bank register: bank 0 is the flat 64 KB space, the others are allocated on first touch;
+    // the last bank looked up is cached like a one-entry TLB, so staying in a bank costs one compare over a flat access
+    class bank_memory
+    {
+    public:
+        using bank_type = std::array<std::uint8_t, 0x10000>;
+        
+        explicit bank_memory(std::uint8_t* flat) noexcept
+            : flat(flat), base(flat)
+        {
+        }
+        
+        bank_memory(const bank_memory&) = delete;
+        bank_memory& operator=(const bank_memory&) = delete;
+        
+        std::uint8_t* bank(std::uint8_t index) noexcept
+        {
+            if (index != cached)
+            {
+                refill(index);
+            }
+            
+            return base;
+        }
+        
+        // a 24-bit physical address, bank in the upper byte
+        std::uint8_t& operator[](std::uint32_t address) noexcept
+        {
+            return bank(static_cast<std::uint8_t>(address >> 16))[address & 0xFFFF];
+        }
+        
+        // a bank that was never touched reads as all zero and has no storage yet
+        const std::uint8_t* find(std::uint8_t index) const noexcept
+        {
+            return index ? (far[index - 1] ? far[index - 1]->data() : nullptr) : flat;
+        }
+        
+        void clear(void) noexcept
+        {
+            for (auto& bank : far)
+            {
+                bank.reset();
+            }
+            
+            cached = 0;
+            base = flat;
+        }
+    
+    private:
+        std::uint8_t* flat;
+        std::array<std::unique_ptr<bank_type>, 0xFF> far{};
+        
+        std::uint8_t cached = 0;
+        std::uint8_t* base;
+        
+        void refill(std::uint8_t index) noexcept
+        {
+            cached = index;
+            
+            if (index == 0)
+            {
+                base = flat;
+                return;
+            }
+            
+            auto& bank = far[index - 1];
+            
+            if (!bank)
+            {
+                bank = std::make_unique<bank_type>();
+            }
+            
+            base = bank->data();
+        }
+    };
+}
@@ -0,0 +1,1427 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cctype>
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <array>
+
+#include "microcode.h"
+#include "assembler.h"
+
+namespace
+{
+    // a C-like language over 8-bit unsigned values, compiled to the base instruction set so it runs on every board:
+    //   statements   var x = e;   x = e;   [address] = e;   if (c) { ... } else { ... }   while (c) { ... }   { ... }   halt;
+    //   expressions  numbers, variables, [address], (e), ~e, -e, e + e, e - e, e << n, e >> n, e & e, e | e
+    //   conditions   e, or two expressions compared with == != < > <= >=, unsigned
+    // a variable is visible from its declaration to the end of its block
+    enum class operation
+    {
+        add, subtract, bit_and, bit_or, shift_left, shift_right, complement,
+    };
+    
+    struct expression
+    {
+        enum class kind
+        {
+            constant, variable, load, unary, binary,
+        };
+        
+        kind type;
+        operation op = operation::add;
+        unsigned int value = 0; //the constant, variable index or address
+        std::unique_ptr<expression> lhs{}, rhs{};
+    };
+    
+    // the flag state that makes a condition true
+    enum class relation
+    {
+        zero, nonzero, carry, no_carry,
+    };
+    
+    constexpr relation negate(relation holds) noexcept
+    {
+        switch (holds)
+        {
+            case relation::zero:    return relation::nonzero;
+            case relation::nonzero: return relation::zero;
+            case relation::carry:   return relation::no_carry;
+            default:                return relation::carry;
+        }
+    }
+    
+    // comparisons subtract rhs from lhs, without rhs lhs is tested against zero
+    struct condition
+    {
+        relation holds = relation::nonzero;
+        std::unique_ptr<expression> lhs{}, rhs{};
+    };
+    
+    struct statement
+    {
+        enum class kind
+        {
+            assign, store, branch, loop, halt,
+        };
+        
+        kind type;
+        unsigned int target = 0; //variable index or address
+        std::unique_ptr<expression> value{};
+        condition test{};
+        std::vector<statement> body{}, otherwise{};
+        std::size_t position = 0, last = 0; //pre-order number and the highest number inside it
+    };
+    
+    struct syntax_tree
+    {
+        std::vector<std::string> variables{};
+        std::vector<statement> statements{};
+    };
+    
+    struct compile_error
+    {
+        unsigned int line;
+        std::string message;
+    };
+    
+    // recursive descent straight off the source text, stops at the first error
+    class parser
+    {
+    public:
+        explicit parser(std::string_view source) : source(source)
+        {
+            advance();
+        }
+        
+        std::optional<compile_error> error{};
+        
+        std::optional<syntax_tree> parse(void)
+        {
+            scopes.emplace_back();
+            
+            while (kind != token::end && !error)
+            {
+                parse_statement(tree.statements);
+            }
+            
+            if (error)
+            {
+                return std::nullopt;
+            }
+            
+            return std::move(tree);
+        }
+    
+    private:
+        enum class token
+        {
+            end, number, name, symbol,
+        };
+        
+        std::string_view source;
+        std::size_t offset = 0;
+        unsigned int line = 1;
+        
+        token kind = token::end;
+        std::string_view text{};
+        unsigned int number = 0;
+        
+        syntax_tree tree{};
+        std::vector<std::vector<std::pair<std::string_view, unsigned int>>> scopes{};
+        
+        void advance(void)
+        {
+            while (offset < source.size())
+            {
+                if (source.substr(offset, 2) == "//")
+                {
+                    while (offset < source.size() && source[offset] != '\n') ++offset;
+                }
+                
+                else if (std::isspace(static_cast<unsigned char>(source[offset])))
+                {
+                    line += (source[offset++] == '\n');
+                }
+                
+                else break;
+            }
+            
+            const auto start = offset;
+            
+            if (offset == source.size())
+            {
+                kind = token::end;
+            }
+            
+            else if (std::isdigit(static_cast<unsigned char>(source[offset])))
+            {
+                const auto hex = source.substr(offset, 2) == "0x" || source.substr(offset, 2) == "0X";
+                const auto digit = [&](unsigned char c) { return hex ? std::isxdigit(c) != 0 : std::isdigit(c) != 0; };
+                
+                offset += hex ? 2 : 0;
+                number = 0;
+                
+                for (; offset < source.size() && digit(static_cast<unsigned char>(source[offset])); ++offset)
+                {
+                    const auto c = static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(source[offset])));
+                    number = std::min(number * (hex ? 16u : 10u) + (std::isdigit(c) ? c - '0' : c - 'a' + 10u), 0x10000u);
+                }
+                
+                kind = token::number;
+            }
+            
+            else if (std::isalpha(static_cast<unsigned char>(source[offset])) || source[offset] == '_')
+            {
+                while (offset < source.size() && (std::isalnum(static_cast<unsigned char>(source[offset])) || source[offset] == '_')) ++offset;
+                kind = token::name;
+            }
+            
+            else
+            {
+                static constexpr auto pairs = std::to_array<std::string_view>({ "<<", ">>", "==", "!=", "<=", ">=" });
+                offset += (std::find(pairs.begin(), pairs.end(), source.substr(offset, 2)) != pairs.end()) ? 2 : 1;
+                kind = token::symbol;
+            }
+            
+            text = source.substr(start, offset - start);
+        }
+        
+        bool fail(const std::string& message)
+        {
+            if (!error)
+            {
+                error = compile_error{ line, message };
+            }
+            
+            return false;
+        }
+        
+        std::string here(void) const
+        {
+            return (kind == token::end) ? "end of file" : "'" + std::string(text) + "'";
+        }
+        
+        bool accept(std::string_view symbol)
+        {
+            if (kind != token::end && kind != token::number && text == symbol)
+            {
+                advance();
+                return true;
+            }
+            
+            return false;
+        }
+        
+        bool expect(std::string_view symbol)
+        {
+            return accept(symbol) || fail("expected '" + std::string(symbol) + "' before " + here());
+        }
+        
+        static bool keyword(std::string_view name) noexcept
+        {
+            return name == "var" || name == "if" || name == "else" || name == "while" || name == "halt";
+        }
+        
+        std::optional<unsigned int> lookup(std::string_view name) const
+        {
+            for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope)
+            {
+                for (const auto& [declared, index] : *scope)
+                {
+                    if (declared == name) return index;
+                }
+            }
+            
+            return std::nullopt;
+        }
+        
+        std::optional<unsigned int> name(void)
+        {
+            if (kind != token::name || keyword(text))
+            {
+                fail("expected a variable name before " + here());
+                return std::nullopt;
+            }
+            
+            const auto found = lookup(text);
+            
+            if (!found)
+            {
+                fail("'" + std::string(text) + "' is not declared");
+            }
+            
+            advance();
+            return found;
+        }
+        
+        std::optional<unsigned int> address(void)
+        {
+            if (kind != token::number || number > 0xFFFF)
+            {
+                fail("expected a 16-bit address before " + here());
+                return std::nullopt;
+            }
+            
+            const auto value = number;
+            advance();
+            
+            return expect("]") ? std::optional(value) : std::nullopt;
+        }
+        
+        void parse_statement(std::vector<statement>& out)
+        {
+            if (accept("var"))
+            {
+                const auto declared = text;
+                
+                if (kind != token::name || keyword(declared))
+                {
+                    fail("expected a variable name before " + here());
+                    return;
+                }
+                
+                advance();
+                
+                // the initialiser still sees an outer variable of the same name
+                auto value = expect("=") ? parse_expression() : nullptr;
+                
+                if (!value || !expect(";"))
+                {
+                    return;
+                }
+                
+                for (const auto& [existing, index] : scopes.back())
+                {
+                    if (existing == declared)
+                    {
+                        fail("'" + std::string(declared) + "' is already declared in this block");
+                        return;
+                    }
+                }
+                
+                const auto index = static_cast<unsigned int>(tree.variables.size());
+                
+                tree.variables.emplace_back(declared);
+                scopes.back().emplace_back(declared, index);
+                out.push_back(statement{ statement::kind::assign, index, std::move(value) });
+            }
+            
+            else if (accept("if"))
+            {
+                auto branch = statement{ statement::kind::branch };
+                
+                if (!expect("(") || !parse_condition(branch.test) || !expect(")") || !parse_block(branch.body))
+                {
+                    return;
+                }
+                
+                if (accept("else"))
+                {
+                    if (kind == token::name && text == "if")
+                    {
+                        scopes.emplace_back();
+                        parse_statement(branch.otherwise);
+                        scopes.pop_back();
+                    }
+                    
+                    else if (!parse_block(branch.otherwise))
+                    {
+                        return;
+                    }
+                }
+                
+                out.push_back(std::move(branch));
+            }
+            
+            else if (accept("while"))
+            {
+                auto loop = statement{ statement::kind::loop };
+                
+                if (expect("(") && parse_condition(loop.test) && expect(")") && parse_block(loop.body))
+                {
+                    out.push_back(std::move(loop));
+                }
+            }
+            
+            // a bare block only opens a scope, its statements join the enclosing list
+            else if (kind == token::symbol && text == "{")
+            {
+                parse_block(out);
+            }
+            
+            else if (accept("halt"))
+            {
+                if (expect(";"))
+                {
+                    out.push_back(statement{ statement::kind::halt });
+                }
+            }
+            
+            else if (accept("["))
+            {
+                const auto target = address();
+                auto value = (target && expect("=")) ? parse_expression() : nullptr;
+                
+                if (value && expect(";"))
+                {
+                    out.push_back(statement{ statement::kind::store, *target, std::move(value) });
+                }
+            }
+            
+            else if (kind == token::name && !keyword(text))
+            {
+                const auto target = name();
+                auto value = (target && expect("=")) ? parse_expression() : nullptr;
+                
+                if (value && expect(";"))
+                {
+                    out.push_back(statement{ statement::kind::assign, *target, std::move(value) });
+                }
+            }
+            
+            else
+            {
+                fail("expected a statement before " + here());
+            }
+        }
+        
+        bool parse_block(std::vector<statement>& body)
+        {
+            if (!expect("{"))
+            {
+                return false;
+            }
+            
+            scopes.emplace_back();
+            
+            while (!error && !accept("}"))
+            {
+                if (kind == token::end)
+                {
+                    return fail("expected '}' before end of file");
+                }
+                
+                parse_statement(body);
+            }
+            
+            scopes.pop_back();
+            return !error;
+        }
+        
+        bool parse_condition(condition& test)
+        {
+            static constexpr auto comparisons = std::to_array<std::tuple<std::string_view, relation, bool>>(
+            {
+                { "==", relation::zero, false }, { "!=", relation::nonzero, false },
+                { "<", relation::carry, false }, { ">=", relation::no_carry, false },
+                { ">", relation::carry, true }, { "<=", relation::no_carry, true },
+            });
+            
+            test.lhs = parse_expression();
+            
+            if (!test.lhs)
+            {
+                return false;
+            }
+            
+            for (const auto& [symbol, holds, swapped] : comparisons)
+            {
+                if (accept(symbol))
+                {
+                    test.rhs = parse_expression();
+                    test.holds = holds;
+                    
+                    if (!test.rhs)
+                    {
+                        return false;
+                    }
+                    
+                    if (swapped)
+                    {
+                        std::swap(test.lhs, test.rhs);
+                    }
+                    
+                    // equality with zero needs no subtraction, only the zero flag of the other side
+                    const auto zero = [](const std::unique_ptr<expression>& e) { return e->type == expression::kind::constant && e->value == 0; };
+                    
+                    if ((holds == relation::zero || holds == relation::nonzero) && (zero(test.lhs) || zero(test.rhs)))
+                    {
+                        if (zero(test.lhs)) std::swap(test.lhs, test.rhs);
+                        test.rhs.reset();
+                    }
+                    
+                    return true;
+                }
+            }
+            
+            test.holds = relation::nonzero;
+            return true;
+        }
+        
+        static std::unique_ptr<expression> combine(operation op, std::unique_ptr<expression> lhs, std::unique_ptr<expression> rhs)
+        {
+            auto e = std::make_unique<expression>(expression{ rhs ? expression::kind::binary : expression::kind::unary, op });
+            
+            e->lhs = std::move(lhs);
+            e->rhs = std::move(rhs);
+            
+            return e;
+        }
+        
+        static std::unique_ptr<expression> constant(unsigned int value)
+        {
+            return std::make_unique<expression>(expression{ expression::kind::constant, operation::add, value });
+        }
+        
+        std::unique_ptr<expression> parse_expression(void)
+        {
+            return parse_binary(0);
+        }
+        
+        // | binds loosest, then &, then the shifts, then + and -
+        std::unique_ptr<expression> parse_binary(unsigned int level)
+        {
+            static constexpr auto levels = std::to_array<std::array<std::pair<std::string_view, operation>, 2>>(
+            {
+                {{ { "|", operation::bit_or }, { "|", operation::bit_or } }},
+                {{ { "&", operation::bit_and }, { "&", operation::bit_and } }},
+                {{ { "<<", operation::shift_left }, { ">>", operation::shift_right } }},
+                {{ { "+", operation::add }, { "-", operation::subtract } }},
+            });
+            
+            if (level == levels.size())
+            {
+                return parse_unary();
+            }
+            
+            auto lhs = parse_binary(level + 1);
+            
+            while (lhs)
+            {
+                const auto it = std::find_if(levels[level].begin(), levels[level].end(), [&](const auto& entry) { return kind == token::symbol && text == entry.first; });
+                
+                if (it == levels[level].end())
+                {
+                    break;
+                }
+                
+                advance();
+                
+                if (it->second == operation::shift_left || it->second == operation::shift_right)
+                {
+                    if (kind != token::number)
+                    {
+                        fail("shift counts have to be constants");
+                        return nullptr;
+                    }
+                    
+                    lhs = combine(it->second, std::move(lhs), constant(std::min(number, 8u)));
+                    advance();
+                }
+                
+                else
+                {
+                    auto rhs = parse_binary(level + 1);
+                    lhs = rhs ? combine(it->second, std::move(lhs), std::move(rhs)) : nullptr;
+                }
+            }
+            
+            return lhs;
+        }
+        
+        std::unique_ptr<expression> parse_unary(void)
+        {
+            if (accept("~"))
+            {
+                auto operand = parse_unary();
+                return operand ? combine(operation::complement, std::move(operand), nullptr) : nullptr;
+            }
+            
+            // two's complement, -e is ~e + 1
+            if (accept("-"))
+            {
+                auto operand = parse_unary();
+                return operand ? combine(operation::add, combine(operation::complement, std::move(operand), nullptr), constant(1)) : nullptr;
+            }
+            
+            return parse_primary();
+        }
+        
+        std::unique_ptr<expression> parse_primary(void)
+        {
+            if (kind == token::number)
+            {
+                if (number > 0xFF)
+                {
+                    fail("constant " + std::string(text) + " does not fit in a byte");
+                    return nullptr;
+                }
+                
+                auto e = constant(number);
+                advance();
+                return e;
+            }
+            
+            if (kind == token::name && !keyword(text))
+            {
+                const auto index = name();
+                return index ? std::make_unique<expression>(expression{ expression::kind::variable, operation::add, *index }) : nullptr;
+            }
+            
+            if (accept("["))
+            {
+                const auto at = address();
+                return at ? std::make_unique<expression>(expression{ expression::kind::load, operation::add, *at }) : nullptr;
+            }
+            
+            if (accept("("))
+            {
+                auto e = parse_expression();
+                return (e && expect(")")) ? std::move(e) : nullptr;
+            }
+            
+            fail("expected an expression before " + here());
+            return nullptr;
+        }
+    };
+    
+    constexpr const auto register_names = std::to_array<const char*>({ "A", "B", "C", "D" });
+    
+    // a scratch byte, then one byte for every variable the allocator could not keep in a register; the stack grows down from the top of memory
+    constexpr const auto spill_base = std::uint16_t{ 0x7F00 };
+    
+    struct allocation
+    {
+        std::vector<std::pair<std::size_t, std::size_t>> live{}; //first and last statement position of every variable
+        std::vector<std::optional<std::size_t>> home{}; //register of every variable, none for those in memory
+        std::vector<std::uint16_t> slot{}; //address of every variable in memory
+    };
+    
+    template<typename visitor>
+    void for_each_variable(const expression& e, visitor&& visit)
+    {
+        if (e.type == expression::kind::variable) visit(e.value);
+        if (e.lhs) for_each_variable(*e.lhs, visit);
+        if (e.rhs) for_each_variable(*e.rhs, visit);
+    }
+    
+    inline void number_statements(std::vector<statement>& statements, std::size_t& next, allocation& regs, std::vector<std::pair<std::size_t, std::size_t>>& loops)
+    {
+        for (auto& s : statements)
+        {
+            s.position = next++;
+            
+            const auto touch = [&](unsigned int variable)
+            {
+                auto& [first, last] = regs.live[variable];
+                
+                first = std::min(first, s.position);
+                last = std::max(last, s.position);
+            };
+            
+            if (s.type == statement::kind::assign) touch(s.target);
+            if (s.value) for_each_variable(*s.value, touch);
+            if (s.test.lhs) for_each_variable(*s.test.lhs, touch);
+            if (s.test.rhs) for_each_variable(*s.test.rhs, touch);
+            
+            number_statements(s.body, next, regs, loops);
+            number_statements(s.otherwise, next, regs, loops);
+            
+            s.last = next - 1;
+            
+            if (s.type == statement::kind::loop)
+            {
+                loops.emplace_back(s.position, s.last);
+            }
+        }
+    }
+    
+    // linear scan over live intervals; when all four registers are taken the interval that ends last goes to memory
+    inline allocation allocate_registers(syntax_tree& tree)
+    {
+        const auto count = tree.variables.size();
+        
+        auto regs = allocation{};
+        auto loops = std::vector<std::pair<std::size_t, std::size_t>>{};
+        auto next = std::size_t{ 0 };
+        
+        regs.live.assign(count, { std::numeric_limits<std::size_t>::max(), 0 });
+        regs.home.assign(count, std::nullopt);
+        regs.slot.assign(count, 0);
+        
+        number_statements(tree.statements, next, regs, loops);
+        
+        // a variable live into a loop is live to its end, the next iteration may read it again
+        for (auto changed = true; changed; )
+        {
+            changed = false;
+            
+            for (const auto& [start, end] : loops)
+            {
+                for (auto& [first, last] : regs.live)
+                {
+                    if (first < start && last >= start && last < end)
+                    {
+                        last = end;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        
+        auto order = std::vector<std::size_t>(count);
+        auto active = std::vector<std::size_t>{};
+        auto free = 0xFu;
+        auto slots = 1u;
+        
+        for (auto i = std::size_t{ 0 }; i < count; ++i) order[i] = i;
+        
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t x, std::size_t y) { return regs.live[x].first < regs.live[y].first; });
+        
+        for (const auto v : order)
+        {
+            std::erase_if(active, [&](std::size_t a)
+            {
+                const auto expired = regs.live[a].second < regs.live[v].first;
+                free |= expired ? (1u << *regs.home[a]) : 0u;
+                return expired;
+            });
+            
+            if (free)
+            {
+                regs.home[v] = static_cast<std::size_t>(std::countr_zero(free));
+                free &= free - 1;
+                active.push_back(v);
+                continue;
+            }
+            
+            const auto victim = std::max_element(active.begin(), active.end(), [&](std::size_t x, std::size_t y) { return regs.live[x].second < regs.live[y].second; });
+            
+            if (regs.live[*victim].second > regs.live[v].second)
+            {
+                std::swap(regs.home[v], regs.home[*victim]);
+                regs.slot[*victim] = static_cast<std::uint16_t>(spill_base + slots++);
+                *victim = v;
+            }
+            
+            else
+            {
+                regs.slot[v] = static_cast<std::uint16_t>(spill_base + slots++);
+            }
+        }
+        
+        return regs;
+    }
+    
+    // the register forms of every instruction the compiler selects, two-register forms are [destination][source]
+    struct register_opcodes
+    {
+        std::array<std::uint8_t, 4> load_immediate, load, store, push, pop, invert, adc_immediate, sbb_immediate, and_immediate, lor_immediate, rol, ror;
+        std::array<std::array<std::uint8_t, 4>, 4> move, adc, sbb, bit_and, bit_or;
+    };
+    
+#define EACH(op, suffix) { op##_A##suffix, op##_B##suffix, op##_C##suffix, op##_D##suffix }
+#define PAIRS(op) {{ { NOP, op##_A_B, op##_A_C, op##_A_D }, { op##_B_A, NOP, op##_B_C, op##_B_D }, \
+                     { op##_C_A, op##_C_B, NOP, op##_C_D }, { op##_D_A, op##_D_B, op##_D_C, NOP } }}
+    constexpr const auto opcodes = register_opcodes
+    {
+        EACH(LDB, _IMM), EACH(LDB, _MEM), EACH(STB_MEM, ), EACH(PUSH, ), EACH(POP, ), EACH(NOT, ),
+        EACH(ADC, _IMM), EACH(SBB, _IMM), EACH(AND, _IMM), EACH(LOR, _IMM), EACH(ROL, _IMM), EACH(ROR, _IMM),
+        PAIRS(MVB), PAIRS(ADC), PAIRS(SBB), PAIRS(AND), PAIRS(LOR),
+    };
+#undef EACH
+#undef PAIRS
+    
+    // tree-walking code generation; where there is more than one way to emit something every candidate is emitted on the side
+    // and the one with the fewest cycles, by the step counts of this encoding's microcode, is kept
+    template<trap_encoding encoding>
+    class code_generator
+    {
+    public:
+        explicit code_generator(const allocation& regs) noexcept : regs(regs)
+        {
+            static constexpr auto& µcode = encoded_µcode<encoding, current_layout>;
+            
+            for (auto opcode = std::size_t{ 0 }; opcode < cycles.size(); ++opcode)
+            {
+                cycles[opcode] = µcode_steps(µcode[opcode]);
+            }
+        }
+        
+        assembler code{};
+        std::size_t spills = 0; //values parked on the stack or in the scratch byte because no register was free
+        
+        void generate(const std::vector<statement>& list)
+        {
+            for (const auto& s : list)
+            {
+                enter(s.position);
+                
+                switch (s.type)
+                {
+                    case statement::kind::assign:
+                        assign(s.target, *s.value);
+                        break;
+                    
+                    case statement::kind::store:
+                        store(static_cast<std::uint16_t>(s.target), *s.value);
+                        break;
+                    
+                    // with an else part whose test jumps in one instruction when it holds, the else part goes first
+                    case statement::kind::branch:
+                    {
+                        const auto otherwise = code.make_label(), end = code.make_label();
+                        const auto swapped = !s.otherwise.empty() && (s.test.holds == relation::zero || s.test.holds == relation::carry);
+                        const auto& first = swapped ? s.otherwise : s.body;
+                        const auto& second = swapped ? s.body : s.otherwise;
+                        
+                        branch(s.test, otherwise, swapped);
+                        generate(first);
+                        
+                        if (!second.empty())
+                        {
+                            jump(JMP_MEM, end);
+                        }
+                        
+                        bind(otherwise);
+                        generate(second);
+                        bind(end);
+                        break;
+                    }
+                    
+                    // tested once on entry and again below the body, so an iteration takes one jump and the flags the body leaves are still known
+                    case statement::kind::loop:
+                    {
+                        const auto top = code.make_label(), end = code.make_label();
+                        
+                        branch(s.test, end, false);
+                        bind(top);
+                        generate(s.body);
+                        enter(s.position);
+                        branch(s.test, top, true);
+                        bind(end);
+                        break;
+                    }
+                    
+                    case statement::kind::halt:
+                        emit(BRK);
+                        break;
+                }
+            }
+        }
+    
+    private:
+        using reg = std::size_t;
+        
+        const allocation& regs;
+        std::array<unsigned int, 0x100> cycles{};
+        std::uint64_t cost = 0;
+        
+        // what the flags are known to hold, forgotten at every label
+        bool carry_clear = false;
+        std::optional<reg> zero_of{};
+        
+        std::size_t position = 0;
+        unsigned int occupied = 0; //registers of the variables live at the current statement
+        std::optional<unsigned int> parked{}; //variable whose register was saved to the scratch byte
+        
+        static constexpr unsigned int bit(reg r) noexcept
+        {
+            return 1u << r;
+        }
+        
+        void enter(std::size_t at) noexcept
+        {
+            position = at;
+            occupied = 0;
+            
+            for (auto v = std::size_t{ 0 }; v < regs.home.size(); ++v)
+            {
+                if (regs.home[v] && regs.live[v].first <= at && at <= regs.live[v].second) occupied |= bit(*regs.home[v]);
+            }
+        }
+        
+        std::optional<reg> home(unsigned int variable) const noexcept
+        {
+            return (parked == variable) ? std::nullopt : regs.home[variable];
+        }
+        
+        std::uint16_t slot(unsigned int variable) const noexcept
+        {
+            return (parked == variable) ? spill_base : regs.slot[variable];
+        }
+        
+        std::optional<unsigned int> resident(reg r) const noexcept
+        {
+            for (auto v = 0u; v < regs.home.size(); ++v)
+            {
+                if (regs.home[v] == r && regs.live[v].first <= position && position <= regs.live[v].second) return v;
+            }
+            
+            return std::nullopt;
+        }
+        
+        bool reads(const expression& e, reg r) const noexcept
+        {
+            auto found = false;
+            for_each_variable(e, [&](unsigned int v) { found |= (home(v) == r); });
+            return found;
+        }
+        
+        // e can be evaluated into r when r is only read before anything is written to it
+        bool clobber_safe(const expression& e, reg r) const noexcept
+        {
+            switch (e.type)
+            {
+                case expression::kind::unary:  return clobber_safe(*e.lhs, r);
+                case expression::kind::binary: return clobber_safe(*e.lhs, r) && !reads(*e.rhs, r);
+                default:                       return true;
+            }
+        }
+        
+        void emit(std::uint8_t opcode)
+        {
+            code.emit(opcode);
+            cost += cycles[opcode];
+        }
+        
+        void emit(std::uint8_t opcode, std::uint8_t operand)
+        {
+            code.emit(opcode, operand);
+            cost += cycles[opcode];
+        }
+        
+        void emit_absolute(std::uint8_t opcode, std::uint16_t address)
+        {
+            code.emit_absolute(opcode, address);
+            cost += cycles[opcode];
+        }
+        
+        void jump(std::uint8_t opcode, assembler::label target)
+        {
+            code.emit(opcode, target);
+            cost += cycles[opcode];
+        }
+        
+        void bind(assembler::label target)
+        {
+            code.bind(target);
+            carry_clear = false;
+            zero_of.reset();
+        }
+        
+        // register writes outside the ALU leave the flags alone
+        void wrote(reg r) noexcept
+        {
+            if (zero_of == r) zero_of.reset();
+        }
+        
+        // ALU results set Z, logic operations and rotates also clear carry
+        void computed(reg r, bool logic) noexcept
+        {
+            zero_of = r;
+            carry_clear = logic;
+        }
+        
+        void cheapest(const std::vector<std::function<void(void)>>& candidates)
+        {
+            auto best = std::size_t{ 0 };
+            auto best_cost = std::pair{ std::numeric_limits<std::uint64_t>::max(), std::numeric_limits<std::size_t>::max() };
+            
+            for (auto i = std::size_t{ 0 }; candidates.size() > 1 && i < candidates.size(); ++i)
+            {
+                auto saved_code = std::exchange(code, assembler{});
+                const auto saved = std::tuple(cost, carry_clear, zero_of, spills);
+                
+                cost = 0;
+                candidates[i]();
+                
+                if (const auto trial = std::pair{ cost, std::size_t{ code.here() } }; trial < best_cost)
+                {
+                    best = i;
+                    best_cost = trial;
+                }
+                
+                code = std::move(saved_code);
+                std::tie(cost, carry_clear, zero_of, spills) = saved;
+            }
+            
+            candidates[best]();
+        }
+        
+        void save(reg r)
+        {
+            emit(opcodes.push[r]);
+            ++spills;
+        }
+        
+        void restore(reg r)
+        {
+            emit(opcodes.pop[r]);
+            wrote(r);
+        }
+        
+        // the variable in r moves to the scratch byte, reads of it load from there
+        void park(reg r)
+        {
+            emit_absolute(opcodes.store[r], spill_base);
+            parked = resident(r);
+            ++spills;
+        }
+        
+        void unpark(reg r)
+        {
+            emit_absolute(opcodes.load[r], spill_base);
+            wrote(r);
+            parked.reset();
+        }
+        
+        void load_constant(reg d, std::uint8_t k)
+        {
+            auto options = std::vector<std::function<void(void)>>{ [=, this] { emit(opcodes.load_immediate[d], k); wrote(d); } };
+            
+            if (k == 0)
+            {
+                options.push_back([=, this] { emit(opcodes.and_immediate[d], 0); computed(d, true); });
+            }
+            
+            cheapest(options);
+        }
+        
+        // both keep r and set Z from it
+        void test_zero(reg r)
+        {
+            if (zero_of != r)
+            {
+                cheapest({ [=, this] { emit(opcodes.and_immediate[r], 0xFF); computed(r, true); },
+                           [=, this] { emit(opcodes.lor_immediate[r], 0x00); computed(r, true); } });
+            }
+        }
+        
+        // ADC and SBB always take the carry in
+        void clear_carry(reg r)
+        {
+            if (!carry_clear)
+            {
+                cheapest({ [=, this] { emit(opcodes.and_immediate[r], 0xFF); computed(r, true); },
+                           [=, this] { emit(opcodes.lor_immediate[r], 0x00); computed(r, true); } });
+            }
+        }
+        
+        void evaluate(const expression& e, reg d, unsigned int reserved)
+        {
+            switch (e.type)
+            {
+                case expression::kind::constant:
+                    load_constant(d, static_cast<std::uint8_t>(e.value));
+                    break;
+                
+                case expression::kind::variable:
+                    if (const auto r = home(e.value))
+                    {
+                        if (*r != d)
+                        {
+                            emit(opcodes.move[d][*r]);
+                            wrote(d);
+                        }
+                    }
+                    
+                    else
+                    {
+                        emit_absolute(opcodes.load[d], slot(e.value));
+                        wrote(d);
+                    }
+                    
+                    break;
+                
+                case expression::kind::load:
+                    emit_absolute(opcodes.load[d], static_cast<std::uint16_t>(e.value));
+                    wrote(d);
+                    break;
+                
+                case expression::kind::unary:
+                    evaluate(*e.lhs, d, reserved);
+                    emit(opcodes.invert[d]);
+                    computed(d, true);
+                    break;
+                
+                case expression::kind::binary:
+                    if (e.op == operation::shift_left || e.op == operation::shift_right)
+                    {
+                        evaluate(*e.lhs, d, reserved);
+                        shift(e.op, d, e.rhs->value, reserved);
+                    }
+                    
+                    // commutative operations may go either way round, the right operand must not read the destination
+                    else if (e.op != operation::subtract && !reads(*e.lhs, d))
+                    {
+                        cheapest({ [&, d, reserved] { apply(e.op, *e.lhs, *e.rhs, d, reserved); },
+                                   [&, d, reserved] { apply(e.op, *e.rhs, *e.lhs, d, reserved); } });
+                    }
+                    
+                    else
+                    {
+                        apply(e.op, *e.lhs, *e.rhs, d, reserved);
+                    }
+                    
+                    break;
+            }
+        }
+        
+        // evaluates lhs into d and applies rhs to it; d may only be read by lhs, reserved registers hold pending values
+        void apply(operation op, const expression& lhs, const expression& rhs, reg d, unsigned int reserved)
+        {
+            if (rhs.type == expression::kind::constant)
+            {
+                evaluate(lhs, d, reserved);
+                immediate(op, d, static_cast<std::uint8_t>(rhs.value));
+                return;
+            }
+            
+            if (const auto v = (rhs.type == expression::kind::variable) ? home(rhs.value) : std::nullopt; v && *v != d)
+            {
+                evaluate(lhs, d, reserved);
+                registers(op, d, *v);
+                return;
+            }
+            
+            // the right operand needs a register of its own; taking one keeps a register spare for the nested case below
+            const auto in_use = reserved | bit(d);
+            
+            if (std::popcount(in_use) <= 2)
+            {
+                if (const auto free = 0xFu & ~occupied & ~in_use)
+                {
+                    const auto s = static_cast<reg>(std::countr_zero(free));
+                    
+                    evaluate(lhs, d, reserved);
+                    evaluate(rhs, s, in_use);
+                    registers(op, d, s);
+                    return;
+                }
+                
+                for (auto v = reg{ 0 }; v < 4; ++v)
+                {
+                    if (!(in_use & bit(v)) && clobber_safe(rhs, v))
+                    {
+                        evaluate(lhs, d, reserved);
+                        save(v);
+                        evaluate(rhs, v, in_use);
+                        registers(op, d, v);
+                        restore(v);
+                        return;
+                    }
+                }
+            }
+            
+            // otherwise the pending operand waits on the stack while the other one is evaluated into d
+            const auto v = static_cast<reg>(std::countr_zero(0xFu & ~in_use));
+            
+            save(v);
+            
+            if (!reads(lhs, d))
+            {
+                evaluate(rhs, d, reserved);
+                save(d);
+                evaluate(lhs, d, reserved);
+                restore(v);
+            }
+            
+            else
+            {
+                evaluate(lhs, d, reserved);
+                save(d);
+                evaluate(rhs, d, reserved);
+                emit(opcodes.move[v][d]);
+                wrote(v);
+                restore(d);
+            }
+            
+            registers(op, d, v);
+            restore(v);
+        }
+        
+        void registers(operation op, reg d, reg s)
+        {
+            switch (op)
+            {
+                case operation::add:
+                    clear_carry(d);
+                    emit(opcodes.adc[d][s]);
+                    computed(d, false);
+                    break;
+                
+                case operation::subtract:
+                    clear_carry(d);
+                    emit(opcodes.sbb[d][s]);
+                    computed(d, false);
+                    break;
+                
+                case operation::bit_and:
+                    emit(opcodes.bit_and[d][s]);
+                    computed(d, true);
+                    break;
+                
+                default:
+                    emit(opcodes.bit_or[d][s]);
+                    computed(d, true);
+                    break;
+            }
+        }
+        
+        void immediate(operation op, reg d, std::uint8_t k)
+        {
+            switch (op)
+            {
+                case operation::add:
+                    clear_carry(d);
+                    emit(opcodes.adc_immediate[d], k);
+                    computed(d, false);
+                    break;
+                
+                case operation::subtract:
+                    clear_carry(d);
+                    emit(opcodes.sbb_immediate[d], k);
+                    computed(d, false);
+                    break;
+                
+                case operation::bit_and:
+                    emit(opcodes.and_immediate[d], k);
+                    computed(d, true);
+                    break;
+                
+                default:
+                    emit(opcodes.lor_immediate[d], k);
+                    computed(d, true);
+                    break;
+            }
+        }
+        
+        // a rotate and a mask, or for short left shifts repeated doubling through a free register
+        void shift(operation op, reg d, unsigned int count, unsigned int reserved)
+        {
+            if (count == 0)
+            {
+                return;
+            }
+            
+            if (count >= 8)
+            {
+                load_constant(d, 0);
+                return;
+            }
+            
+            const auto left = (op == operation::shift_left);
+            const auto mask = static_cast<std::uint8_t>(left ? (0xFF << count) : (0xFF >> count));
+            
+            auto options = std::vector<std::function<void(void)>>
+            {
+                [=, this]
+                {
+                    emit(left ? opcodes.rol[d] : opcodes.ror[d], static_cast<std::uint8_t>(count));
+                    emit(opcodes.and_immediate[d], mask);
+                    computed(d, true);
+                },
+            };
+            
+            if (const auto free = 0xFu & ~occupied & ~reserved & ~bit(d); left && free)
+            {
+                const auto s = static_cast<reg>(std::countr_zero(free));
+                
+                options.push_back([=, this]
+                {
+                    for (auto i = 0u; i < count; ++i)
+                    {
+                        emit(opcodes.move[s][d]);
+                        wrote(s);
+                        clear_carry(d);
+                        emit(opcodes.adc[d][s]);
+                        computed(d, false);
+                    }
+                });
+            }
+            
+            cheapest(options);
+        }
+        
+        // runs use(r) on a register it may overwrite: a free one, one saved on the stack around it, or one whose variable is parked
+        void with_register(const std::function<bool(reg)>& usable, const std::function<void(reg)>& use)
+        {
+            auto options = std::vector<std::function<void(void)>>{};
+            
+            for (auto r = reg{ 0 }; r < 4; ++r)
+            {
+                if (!(occupied & bit(r)))
+                {
+                    options.push_back([&, r] { use(r); });
+                }
+                
+                else if (usable(r))
+                {
+                    options.push_back([&, r] { save(r); use(r); restore(r); });
+                }
+            }
+            
+            if (options.empty())
+            {
+                for (auto r = reg{ 0 }; r < 4; ++r)
+                {
+                    options.push_back([&, r] { park(r); use(r); unpark(r); });
+                }
+            }
+            
+            cheapest(options);
+        }
+        
+        void assign(unsigned int variable, const expression& value)
+        {
+            const auto r = home(variable);
+            
+            if (!r)
+            {
+                store(slot(variable), value);
+                return;
+            }
+            
+            auto options = std::vector<std::function<void(void)>>{};
+            
+            if (clobber_safe(value, *r))
+            {
+                options.push_back([&] { evaluate(value, *r, 0); });
+            }
+            
+            options.push_back([&]
+            {
+                with_register([&](reg t) { return t != *r && clobber_safe(value, t); }, [&](reg t)
+                {
+                    evaluate(value, t, 0);
+                    emit(opcodes.move[*r][t]);
+                    wrote(*r);
+                });
+            });
+            
+            // the old value stays readable from the scratch byte while the new one is built in place
+            options.push_back([&]
+            {
+                park(*r);
+                evaluate(value, *r, 0);
+                parked.reset();
+            });
+            
+            cheapest(options);
+        }
+        
+        void store(std::uint16_t address, const expression& value)
+        {
+            if (const auto r = (value.type == expression::kind::variable) ? home(value.value) : std::nullopt)
+            {
+                emit_absolute(opcodes.store[*r], address);
+                return;
+            }
+            
+            with_register([&](reg t) { return clobber_safe(value, t); }, [&](reg t)
+            {
+                evaluate(value, t, 0);
+                emit_absolute(opcodes.store[t], address);
+            });
+        }
+        
+        void branch(const condition& test, assembler::label target, bool when)
+        {
+            if (!test.rhs)
+            {
+                if (const auto r = (test.lhs->type == expression::kind::variable) ? home(test.lhs->value) : std::nullopt)
+                {
+                    test_zero(*r);
+                }
+                
+                else
+                {
+                    with_register([&](reg t) { return clobber_safe(*test.lhs, t); }, [&](reg t)
+                    {
+                        evaluate(*test.lhs, t, 0);
+                        test_zero(t);
+                    });
+                }
+            }
+            
+            // a restore after the subtraction is a POP or a load, neither touches the flags
+            else
+            {
+                with_register([&](reg t) { return clobber_safe(*test.lhs, t) && !reads(*test.rhs, t); }, [&](reg t)
+                {
+                    apply(operation::subtract, *test.lhs, *test.rhs, t, 0);
+                });
+            }
+            
+            const auto holds = when ? test.holds : negate(test.holds);
+            
+            if (holds == relation::zero || holds == relation::carry)
+            {
+                jump(holds == relation::zero ? JEZ_MEM : JCS_MEM, target);
+            }
+            
+            else
+            {
+                const auto skip = code.make_label();
+                
+                jump(holds == relation::nonzero ? JEZ_MEM : JCS_MEM, skip);
+                jump(JMP_MEM, target);
+                bind(skip);
+            }
+        }
+    };
+    
+    struct compiled_program
+    {
+        std::vector<std::uint8_t> image{};
+        std::vector<std::string> variables{};
+        allocation registers{};
+        std::size_t spills = 0;
+    };
+    
+    // the image starts at address 0 and ends in BRK
+    template<trap_encoding encoding>
+    std::optional<compiled_program> compile(std::string_view source, compile_error& error)
+    {
+        auto front = parser(source);
+        auto tree = front.parse();
+        
+        if (!tree)
+        {
+            error = *front.error;
+            return std::nullopt;
+        }
+        
+        auto result = compiled_program{};
+        result.registers = allocate_registers(*tree);
+        
+        auto generator = code_generator<encoding>(result.registers);
+        generator.generate(tree->statements);
+        generator.code.emit(BRK);
+        
+        result.image = *generator.code.link();
+        result.variables = std::move(tree->variables);
+        result.spills = generator.spills;
+        
+        if (result.image.size() > spill_base)
+        {
+            error = compile_error{ 0, "the program does not fit below the spill area" };
+            return std::nullopt;
+        }
+        
+        return result;
+    }
+}
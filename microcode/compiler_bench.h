@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <array>
+
+#include "microcode.h"
+#include "simulator.h"
+#include "assembler.h"
+#include "compiler.h"
+
+namespace
+{
+    struct compiler_benchmark
+    {
+        const char* name;
+        const char* source;
+        assembler (*hand_written)(void);
+        std::uint16_t result;
+        std::uint8_t expected;
+    };
+    
+    inline assembler fib_by_hand(void)
+    {
+        auto code = assembler{};
+        const auto loop = code.make_label(), done = code.make_label();
+        
+        code.emit(LDB_A_IMM, 0).emit(LDB_B_IMM, 1).emit(LDB_C_IMM, 13);
+        code.bind(loop);
+        code.emit(MVB_D_A).emit(AND_D_IMM, 0xFF).emit(ADC_D_B).emit(MVB_A_B).emit(MVB_B_D);
+        code.emit(AND_C_IMM, 0xFF).emit(SBB_C_IMM, 1).emit(JEZ_MEM, done).emit(JMP_MEM, loop);
+        code.bind(done);
+        code.emit_absolute(STB_MEM_A, 0x8000).emit(BRK);
+        
+        return code;
+    }
+    
+    inline assembler multiply_by_hand(void)
+    {
+        auto code = assembler{};
+        const auto loop = code.make_label(), skip = code.make_label(), done = code.make_label();
+        
+        code.emit(LDB_A_IMM, 13).emit(LDB_B_IMM, 11).emit(LDB_C_IMM, 0);
+        code.bind(loop);
+        code.emit(MVB_D_B).emit(AND_D_IMM, 1).emit(JEZ_MEM, skip).emit(AND_C_IMM, 0xFF).emit(ADC_C_A);
+        code.bind(skip);
+        code.emit(MVB_D_A).emit(AND_D_IMM, 0xFF).emit(ADC_A_D);
+        code.emit(ROR_B_IMM, 1).emit(AND_B_IMM, 0x7F).emit(JEZ_MEM, done).emit(JMP_MEM, loop);
+        code.bind(done);
+        code.emit_absolute(STB_MEM_C, 0x8001).emit(BRK);
+        
+        return code;
+    }
+    
+    inline assembler gcd_by_hand(void)
+    {
+        auto code = assembler{};
+        const auto loop = code.make_label(), less = code.make_label(), done = code.make_label();
+        
+        code.emit(LDB_A_IMM, 84).emit(LDB_B_IMM, 36);
+        code.bind(loop);
+        code.emit(MVB_C_A).emit(AND_C_IMM, 0xFF).emit(SBB_C_B).emit(JEZ_MEM, done).emit(JCS_MEM, less);
+        code.emit(MVB_A_C).emit(JMP_MEM, loop);
+        code.bind(less);
+        code.emit(MVB_C_B).emit(AND_C_IMM, 0xFF).emit(SBB_C_A).emit(MVB_B_C).emit(JMP_MEM, loop);
+        code.bind(done);
+        code.emit_absolute(STB_MEM_A, 0x8002).emit(BRK);
+        
+        return code;
+    }
+    
+    inline assembler popcount_by_hand(void)
+    {
+        auto code = assembler{};
+        const auto loop = code.make_label(), done = code.make_label();
+        
+        code.emit(LDB_A_IMM, 0xB7).emit(LDB_B_IMM, 0);
+        code.bind(loop);
+        code.emit(MVB_C_A).emit(AND_C_IMM, 1).emit(ADC_B_C);
+        code.emit(ROR_A_IMM, 1).emit(AND_A_IMM, 0x7F).emit(JEZ_MEM, done).emit(JMP_MEM, loop);
+        code.bind(done);
+        code.emit_absolute(STB_MEM_B, 0x8003).emit(BRK);
+        
+        return code;
+    }
+    
+    inline const auto compiler_benchmarks = std::to_array<compiler_benchmark>(
+    {
+        { "fib", "var a = 0;\nvar b = 1;\nvar n = 13;\nwhile (n != 0)\n{\n    var t = a + b;\n    a = b;\n    b = t;\n    n = n - 1;\n}\n[0x8000] = a;\n",
+          fib_by_hand, 0x8000, 233 },
+        { "multiply", "var x = 13;\nvar y = 11;\nvar r = 0;\nwhile (y != 0)\n{\n    if (y & 1) { r = r + x; }\n    x = x << 1;\n    y = y >> 1;\n}\n[0x8001] = r;\n",
+          multiply_by_hand, 0x8001, 143 },
+        { "gcd", "var a = 84;\nvar b = 36;\nwhile (a != b)\n{\n    if (a < b) { b = b - a; } else { a = a - b; }\n}\n[0x8002] = a;\n",
+          gcd_by_hand, 0x8002, 12 },
+        { "popcount", "var x = 0xB7;\nvar n = 0;\nwhile (x != 0)\n{\n    n = n + (x & 1);\n    x = x >> 1;\n}\n[0x8003] = n;\n",
+          popcount_by_hand, 0x8003, 6 },
+    });
+    
+    // each routine compiled and written by hand, both run to BRK on the simulator
+    template<trap_encoding encoding, typename layout>
+    int run_compiler_bench(std::uint64_t budget) noexcept
+    {
+        static constexpr auto& µcode = decoded_µcode<encoding, layout>;
+        
+        auto failed = false;
+        
+        for (const auto& bench : compiler_benchmarks)
+        {
+            auto error = compile_error{};
+            const auto program = compile<encoding>(bench.source, error);
+            
+            if (!program)
+            {
+                std::fprintf(stderr, "[Error] Benchmark %s does not compile, line %u: %s\nExiting...\n", bench.name, error.line, error.message.c_str());
+                return EXIT_FAILURE;
+            }
+            
+            auto baseline = machine_state{};
+            
+            for (const auto& [how, image] : { std::pair{ "by hand", *bench.hand_written().link() }, std::pair{ "compiled", program->image } })
+            {
+                auto sim = std::make_unique<simulator<encoding, layout>>(µcode);
+                
+                std::copy(image.begin(), image.end(), sim->memory.begin());
+                sim->run(budget);
+                
+                const auto& state = sim->state;
+                const auto correct = state.halted && state.ir == BRK && sim->memory[bench.result] == bench.expected;
+                
+                if (baseline.retired == 0)
+                {
+                    baseline = state;
+                }
+                
+                std::fprintf(stdout, "[Compiler] %-8s %-8s %4zu bytes %6llu instructions %7llu cycles  %5.1f%% of the cycles %s\n", bench.name, how, image.size(),
+                             static_cast<unsigned long long>(state.retired), static_cast<unsigned long long>(state.cycles),
+                             100.0 * static_cast<double>(state.cycles) / static_cast<double>(baseline.cycles), correct ? "" : "wrong");
+                
+                failed |= !correct;
+            }
+        }
+        
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+}
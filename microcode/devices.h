@@ -0,0 +1,288 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#include <algorithm>
+
+#include <deque>
+#include <array>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "spsc_queue.h"
+
+namespace
+{
+    enum class device : std::uint8_t
+    {
+        ram, rom, uart, timer, gpio,
+    };
+    
+    // one entry per 256-byte page; pages backed by host memory are read and written straight through
+    // the pointers, a null pointer sends the access to the device's slow path
+    struct memory_page
+    {
+        const std::uint8_t* read;
+        std::uint8_t* write;
+        device kind;
+        std::uint8_t latency; //extra cycles per access, charged only on the slow path
+    };
+    
+    // a byte on a serial line between two boards, stamped with the cycle it arrives at
+    struct uart_message
+    {
+        std::uint64_t cycle;
+        std::uint8_t byte;
+    };
+    
+    struct uart_link
+    {
+        spsc_queue<uart_message> queue;
+        std::uint64_t latency;
+    };
+    
+    // 0 data (write transmits, read takes the next received byte), 1 status (bit 0 can transmit, bit 1 has received),
+    // 2/3 station address low/high; without a link transmitted bytes go to stdout
+    struct uart_device
+    {
+        static constexpr const auto latency = std::uint8_t{ 2 };
+        
+        std::deque<std::uint8_t> received{};
+        std::uint64_t transmitted = 0;
+        
+        uart_link* link = nullptr;
+        std::deque<uart_message> arriving{}; //taken off the receive link, not yet due
+        std::uint64_t overruns = 0;
+        std::uint16_t station = 0;
+        
+        std::uint8_t read(std::uint8_t reg, std::uint64_t cycles) noexcept
+        {
+            while (!arriving.empty() && arriving.front().cycle <= cycles)
+            {
+                received.push_back(arriving.front().byte);
+                arriving.pop_front();
+            }
+            
+            if (reg == 1)
+            {
+                return static_cast<std::uint8_t>(0x01 | (received.empty() ? 0 : 0x02));
+            }
+            
+            if (reg == 0 && !received.empty())
+            {
+                const auto byte = received.front();
+                received.pop_front();
+                return byte;
+            }
+            
+            return (reg == 2) ? static_cast<std::uint8_t>(station) : (reg == 3) ? static_cast<std::uint8_t>(station >> 8) : 0;
+        }
+        
+        void write(std::uint8_t reg, std::uint8_t value, std::uint64_t cycles) noexcept
+        {
+            if (reg != 0)
+            {
+                return;
+            }
+            
+            ++transmitted;
+            
+            if (!link)
+            {
+                std::fputc(value, stdout);
+            }
+            
+            // the far end has not drained a whole quantum of bytes, the line drops this one
+            else if (!link->queue.push({ cycles + link->latency, value }))
+            {
+                ++overruns;
+            }
+        }
+    };
+    
+    // free-running counter, only computed from the cycle count when it is read;
+    // 0/1 count low/high (reading low latches high), 2 prescaler, writing it restarts the count
+    struct timer_device
+    {
+        static constexpr const auto latency = std::uint8_t{ 1 };
+        
+        std::uint64_t start = 0;
+        std::uint8_t prescaler = 1, high = 0;
+        
+        std::uint8_t read(std::uint8_t reg, std::uint64_t cycles) noexcept
+        {
+            const auto count = (cycles - start) / (prescaler ? prescaler : 256);
+            
+            switch (reg)
+            {
+                case 0: high = static_cast<std::uint8_t>(count >> 8); return static_cast<std::uint8_t>(count);
+                case 1: return high;
+                case 2: return prescaler;
+                default: return 0;
+            }
+        }
+        
+        void write(std::uint8_t reg, std::uint8_t value, std::uint64_t cycles) noexcept
+        {
+            if (reg == 2)
+            {
+                prescaler = value;
+                start = cycles;
+            }
+        }
+    };
+    
+    // 0 output latch, reads back what was written; 1 input pins
+    struct gpio_device
+    {
+        static constexpr const auto latency = std::uint8_t{ 0 };
+        
+        std::uint8_t output = 0, input = 0;
+        std::uint64_t writes = 0;
+        
+        std::uint8_t read(std::uint8_t reg) const noexcept
+        {
+            return (reg == 0) ? output : (reg == 1) ? input : 0;
+        }
+        
+        void write(std::uint8_t reg, std::uint8_t value) noexcept
+        {
+            if (reg == 0)
+            {
+                output = value;
+                ++writes;
+            }
+        }
+    };
+    
+    class memory_map
+    {
+    public:
+        explicit memory_map(std::uint8_t* ram) noexcept
+        {
+            for (auto page = std::size_t{ 0 }; page < pages.size(); ++page)
+            {
+                pages[page] = { ram + page * 0x100, ram + page * 0x100, device::ram, 0 };
+            }
+        }
+        
+        memory_map(const memory_map&) = delete;
+        memory_map& operator=(const memory_map&) = delete;
+        
+        ~memory_map(void) noexcept
+        {
+            if (rom)
+            {
+                ::munmap(rom, rom_size);
+            }
+        }
+        
+        std::array<memory_page, 0x100> pages{};
+        
+        uart_device uart{};
+        timer_device timer{};
+        gpio_device gpio{};
+        
+        std::uint64_t stalls = 0, rom_writes = 0;
+        
+        enum class rom_mapping
+        {
+            mapped,
+            unreadable,
+            unaligned, //pages map whole, so the image has to start on one
+            too_large, //the image runs past 0xFFFF
+        };
+        
+        // maps the image read-only at base, the pages it covers stop being RAM; one image per map
+        rom_mapping add_rom(const char* path, std::uint16_t base) noexcept
+        {
+            if (base & 0xFF)
+            {
+                return rom_mapping::unaligned;
+            }
+            
+            const auto fd = rom ? -1 : ::open(path, O_RDONLY);
+            
+            if (fd < 0)
+            {
+                return rom_mapping::unreadable;
+            }
+            
+            struct stat info{};
+            const auto size = (::fstat(fd, &info) == 0) ? static_cast<std::size_t>(info.st_size) : 0;
+            
+            if (size > std::size_t{ 0x10000 } - base)
+            {
+                ::close(fd);
+                return rom_mapping::too_large;
+            }
+            
+            const auto mapped = size ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+            
+            ::close(fd);
+            
+            if (mapped == MAP_FAILED)
+            {
+                return rom_mapping::unreadable;
+            }
+            
+            rom = mapped;
+            rom_size = size;
+            
+            for (auto offset = std::size_t{ 0 }; offset < size; offset += 0x100)
+            {
+                pages[(base + offset) >> 8] = { static_cast<const std::uint8_t*>(mapped) + offset, nullptr, device::rom, 0 };
+            }
+            
+            return rom_mapping::mapped;
+        }
+        
+        void add_device(device kind, std::uint16_t base) noexcept
+        {
+            const auto latency = (kind == device::uart) ? uart_device::latency : (kind == device::timer) ? timer_device::latency : gpio_device::latency;
+            pages[base >> 8] = { nullptr, nullptr, kind, latency };
+        }
+        
+        std::uint8_t read(std::uint16_t address, std::uint64_t cycles) noexcept
+        {
+            const auto& page = pages[address >> 8];
+            const auto reg = static_cast<std::uint8_t>(address);
+            
+            stalls += page.latency;
+            
+            switch (page.kind)
+            {
+                case device::uart:  return uart.read(reg, cycles);
+                case device::timer: return timer.read(reg, cycles);
+                case device::gpio:  return gpio.read(reg);
+                default:            return 0;
+            }
+        }
+        
+        void write(std::uint16_t address, std::uint8_t value, std::uint64_t cycles) noexcept
+        {
+            const auto& page = pages[address >> 8];
+            const auto reg = static_cast<std::uint8_t>(address);
+            
+            stalls += page.latency;
+            
+            switch (page.kind)
+            {
+                case device::uart:  uart.write(reg, value, cycles); break;
+                case device::timer: timer.write(reg, value, cycles); break;
+                case device::gpio:  gpio.write(reg, value); break;
+                case device::rom:   ++rom_writes; break;
+                default:            break;
+            }
+        }
+    
+    private:
+        void* rom = nullptr;
+        std::size_t rom_size = 0;
+    };
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <array>
+
+#include "microcode.h"
+#include "simulator.h"
+
+namespace
+{
+    // a hypothetical board built from the current one by a set of microarchitecture knobs:
+    //   fetch_overlap        the PC incrementer addresses the next fetch, so a trailing PC_INI step rides along with it
+    //   separate_address_bus false puts addresses on the data bus, a step ahead of any transfer that needs one
+    //   width                sequencer steps per row, lines that do not fit are cut short and the board is rejected
+    //   flag_addressed       C and Z address the table, so conditional jumps resolve when they are fetched
+    template<bool overlap, bool address_bus, std::size_t steps, bool flags>
+    struct explored_layout
+    {
+        static constexpr const auto id = static_cast<std::uint8_t>(0x80 | (overlap << 0) | (address_bus << 1) | ((steps == 16) << 2) | (flags << 3));
+        static constexpr const auto unsupported = SET_STEP | CLR_STEP;
+        static constexpr const auto has_reset_row = true, latched_alu = false, shared_address_unit = false, stack_grows_up = false;
+        static constexpr const auto fetch_overlap = overlap, separate_address_bus = address_bus, flag_addressed = flags, halt_sets_flags = false;
+        
+        static constexpr const auto width = steps, rows = std::size_t{ flags ? 0x400 : 0x100 }, fetch_steps = std::size_t{ address_bus ? 1 : 2 };
+        
+        static constexpr const auto ADDRESS_DRIVERS = PC_OE | ACU_OE | LSU_SP_EN;
+        static constexpr const auto ADDRESS_SIDE = ADDRESS_DRIVERS | ADU_WE | PC_LRC | PC_INI | FORCE_JUMP | REQUEST_JEZ | REQUEST_JCS | LSU_SP_LD;
+        static constexpr const auto DATA_SIDE = RF_AI | RF_BI | RF_CI | RF_DI | RF_AO | RF_BO | RF_CO | RF_DO | CONNECT_FB |
+                                                ALU_OE | ALU_WA | ALU_WB | OUT_Q1 | OUT_Q2 | ADU_RL | ADU_RH |
+                                                LSU_RE | LSU_WE | IR_WE | ACU_WL | ACU_WH;
+        
+        static constexpr std::array<µcode_type, width> translate(const µcode_line& µinsn) noexcept
+        {
+            auto words = µinsn;
+            auto count = µcode_steps(µinsn);
+            
+            // traps keep their own step so the halt still lands on the trapping instruction
+            if (overlap && count > 1 && (words[count - 1] & ~LEN(3)) == PC_INI)
+            {
+                words[0] |= words[--count];
+                words[count] = 0;
+            }
+            
+            auto out = std::array<µcode_type, width>{};
+            auto n = std::size_t{ 0 };
+            
+            const auto put = [&](µcode_type µop)
+            {
+                if (n < width) out[n] = µop;
+                ++n;
+            };
+            
+            for (auto i = 0u; i < count; ++i)
+            {
+                const auto µop = words[i];
+                
+                if (!address_bus && (µop & ADDRESS_DRIVERS) && (µop & DATA_SIDE))
+                {
+                    put(µop & (ADDRESS_SIDE | LEN(3)));
+                    put(µop & ~ADDRESS_SIDE);
+                }
+                
+                else
+                {
+                    put(µop);
+                }
+            }
+            
+            return out;
+        }
+        
+        static constexpr µcode_type decode(µcode_type µop) noexcept
+        {
+            return µop;
+        }
+    };
+    
+    // the longest row a set of knobs needs, measured on the 16-step variant
+    template<bool overlap, bool address_bus, bool flags>
+    constexpr auto explored_steps(void) noexcept
+    {
+        constexpr auto µcode = write_µcode<trap_encoding::opcode_bit, explored_layout<overlap, address_bus, 16, flags>>();
+        
+        auto longest = 0u;
+        
+        for (const auto& µinsn : µcode)
+        {
+            longest = std::max(longest, µcode_steps(µinsn));
+        }
+        
+        return longest;
+    }
+    
+    struct benchmark
+    {
+        const char* path;
+        std::vector<std::uint8_t> image;
+    };
+    
+    struct exploration
+    {
+        bool overlap, address_bus, flags;
+        std::size_t width, rom_bytes;
+        unsigned int longest;
+        
+        bool fits = false, agrees = true;
+        std::uint64_t cycles = 0;
+        std::vector<machine_state> results{};
+        std::vector<std::uint64_t> memory{}; //FNV-1a over the 64K a benchmark leaves behind
+    };
+    
+    template<bool overlap, bool address_bus, std::size_t width, bool flags>
+    exploration explore_one(const std::vector<benchmark>& suite, std::uint64_t budget) noexcept
+    {
+        using layout = explored_layout<overlap, address_bus, width, flags>;
+        
+        constexpr auto longest = explored_steps<overlap, address_bus, flags>();
+        
+        auto result = exploration{ overlap, address_bus, flags, width, layout::rows * layout::width * sizeof(µcode_type), longest };
+        
+        if constexpr (longest <= width)
+        {
+            static constexpr auto& µcode = encoded_µcode<trap_encoding::opcode_bit, layout>;
+            
+            result.fits = true;
+            
+            for (const auto& bench : suite)
+            {
+                auto sim = std::make_unique<simulator<trap_encoding::opcode_bit, layout>>(µcode);
+                std::copy(bench.image.begin(), bench.image.end(), sim->memory.begin());
+                
+                // trap variants only stop the clock, BRK or the budget end the benchmark
+                while (sim->run(budget - sim->state.cycles), sim->state.halted && sim->state.ir != BRK)
+                {
+                    sim->resume();
+                }
+                
+                result.cycles += sim->state.cycles;
+                result.results.push_back(sim->state);
+                
+                auto hash = 0xCBF29CE484222325ull;
+                
+                for (const auto byte : sim->memory)
+                {
+                    hash = (hash ^ byte) * 0x100000001B3ull;
+                }
+                
+                result.memory.push_back(hash);
+            }
+        }
+        
+        return result;
+    }
+    
+    template<std::size_t... knobs>
+    auto explorations(std::index_sequence<knobs...>) noexcept
+    {
+        using job = std::function<exploration(const std::vector<benchmark>&, std::uint64_t)>;
+        
+        return std::vector<job>{ explore_one<(knobs & 1) != 0, (knobs & 2) == 0, (knobs & 4) ? 16 : 8, (knobs & 8) != 0>... };
+    }
+    
+    int run_explore(const std::vector<benchmark>& suite, unsigned int threads, std::uint64_t budget) noexcept
+    {
+        const auto jobs = explorations(std::make_index_sequence<16>{});
+        
+        auto results = std::vector<exploration>(jobs.size());
+        auto next = std::atomic<std::size_t>{ 0 };
+        
+        auto pool = std::vector<std::thread>{};
+        
+        for (auto i = 0u; i < (threads ? threads : std::max(1u, std::thread::hardware_concurrency())); ++i)
+        {
+            pool.emplace_back([&]
+            {
+                for (auto index = next++; index < jobs.size(); index = next++)
+                {
+                    results[index] = jobs[index](suite, budget);
+                }
+            });
+        }
+        
+        for (auto& thread : pool)
+        {
+            thread.join();
+        }
+        
+        // job 0 is the current board, every other board has to end every benchmark with the same registers and memory
+        const auto same = [](const machine_state& x, const machine_state& y)
+        {
+            return x.a == y.a && x.b == y.b && x.c == y.c && x.d == y.d && x.f == y.f && x.pc == y.pc && x.sp == y.sp && x.halted == y.halted;
+        };
+        
+        for (auto& r : results)
+        {
+            for (auto i = std::size_t{ 0 }; i < r.results.size(); ++i)
+            {
+                r.agrees &= same(r.results[i], results[0].results[i]) && r.memory[i] == results[0].memory[i];
+            }
+        }
+        
+        const auto dominated = [&](const exploration& r)
+        {
+            return std::any_of(results.begin(), results.end(), [&](const exploration& o)
+            {
+                return o.fits && o.agrees && o.rom_bytes <= r.rom_bytes && o.cycles <= r.cycles && (o.rom_bytes < r.rom_bytes || o.cycles < r.cycles);
+            });
+        };
+        
+        std::sort(results.begin(), results.end(), [](const exploration& x, const exploration& y)
+        {
+            return std::pair(x.rom_bytes, x.cycles) < std::pair(y.rom_bytes, y.cycles);
+        });
+        
+        std::fprintf(stdout, "[Explore] %zu benchmarks, %zu boards\n", suite.size(), results.size());
+        std::fprintf(stdout, "[Explore] %-7s %-8s %-5s %-5s %9s %12s  %s\n", "overlap", "bus", "steps", "flags", "rom", "cycles", "");
+        
+        for (const auto& r : results)
+        {
+            std::fprintf(stdout, "[Explore] %-7s %-8s %-5zu %-5s %9zu ", r.overlap ? "on" : "off", r.address_bus ? "separate" : "shared",
+                         r.width, r.flags ? "on" : "off", r.rom_bytes);
+            
+            if (!r.fits)        std::fprintf(stdout, "%12s  needs %u steps\n", "-", r.longest);
+            else if (!r.agrees) std::fprintf(stdout, "%12llu  results differ from the current board\n", static_cast<unsigned long long>(r.cycles));
+            else                std::fprintf(stdout, "%12llu  %s\n", static_cast<unsigned long long>(r.cycles), dominated(r) ? "" : "pareto");
+        }
+        
+        return std::all_of(results.begin(), results.end(), [](const exploration& r) { return r.agrees; }) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+}
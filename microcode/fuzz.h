@@ -0,0 +1,485 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
+#include <vector>
+#include <array>
+
+#include "microcode.h"
+#include "simulator.h"
+#include "golden.h"
+
+namespace
+{
+    struct fuzz_options
+    {
+        std::uint64_t seed = 1, programs = 100'000;
+        unsigned int threads = 0; //0 picks one per hardware thread
+    };
+    
+    // programs are kept as instruction lists so minimising can drop entries without breaking jump targets
+    struct fuzz_instruction
+    {
+        std::uint8_t opcode, q1, q2;
+        std::size_t target; //instruction index a jump lands on, npos for everything else
+    };
+    
+    struct fuzz_program
+    {
+        static constexpr const auto npos = static_cast<std::size_t>(-1);
+        static constexpr const auto data_base = std::uint16_t{ 0x8000 };
+        
+        std::vector<fuzz_instruction> code{};
+        std::array<std::uint8_t, 0x100> data{};
+    };
+    
+    struct divergence
+    {
+        std::uint64_t instruction;
+        std::uint16_t pc;
+        std::uint8_t opcode;
+        const char* field;
+        unsigned int golden, simulated;
+        bool at_end; //memory left behind once the program stopped, pc holds the address
+    };
+    
+    // runs random programs on the golden model and the microcode simulator in lock step, comparing after every instruction
+    template<trap_encoding encoding = trap_encoding::opcode_bit, typename layout = current_layout>
+    class differential_tester
+    {
+    public:
+        static constexpr const auto program_length = std::size_t{ 64 };
+        static constexpr const auto instruction_budget = std::uint64_t{ 4096 };
+        
+        explicit differential_tester(const layout_table<layout>& µcode) noexcept
+            : sim(std::make_unique<simulator<encoding, layout>>(µcode)),
+              golden(std::make_unique<golden_model<encoding, layout::stack_grows_up, layout::halt_sets_flags>>())
+        {
+            // opcode lengths come from the encoding, not from whatever a layout turns LEN into
+            static constexpr auto& lengths = encoded_µcode<encoding, current_layout>;
+            
+            for (auto opcode = 0u; opcode < 0x100; ++opcode)
+            {
+                if (µcode[opcode][1] != 0 && opcode != ROW_IRQ && opcode != ROW_RESET)
+                {
+                    opcodes.push_back(static_cast<std::uint8_t>(opcode));
+                    length[opcode] = static_cast<std::uint8_t>(lengths[opcode][1] >> 62);
+                }
+            }
+        }
+        
+        std::uint64_t instructions = 0;
+        std::array<std::uint64_t, 0x100> executed{};
+        
+        fuzz_program generate(std::uint64_t seed) const
+        {
+            auto rng = std::mt19937_64(seed);
+            auto program = fuzz_program{};
+            
+            for (auto& byte : program.data)
+            {
+                byte = static_cast<std::uint8_t>(rng());
+            }
+            
+            for (auto i = std::size_t{ 0 }; i < program_length; ++i)
+            {
+                const auto opcode = opcodes[rng() % opcodes.size()];
+                auto insn = fuzz_instruction{ opcode, static_cast<std::uint8_t>(rng()), static_cast<std::uint8_t>(rng()), fuzz_program::npos };
+                
+                switch (base(opcode))
+                {
+                    case JEZ_MEM: case JCS_MEM: case JMP_MEM:
+                        insn.target = static_cast<std::size_t>(rng() % (program_length + 1));
+                        break;
+                    
+                    case LDB_A_MEM: case LDB_B_MEM: case LDB_C_MEM: case LDB_D_MEM:
+                    case STB_MEM_A: case STB_MEM_B: case STB_MEM_C: case STB_MEM_D:
+                        insn.q2 = static_cast<std::uint8_t>(fuzz_program::data_base >> 8);
+                        break;
+                    
+                    // flipping between the flat space and one bank keeps the data window in reach half the time
+                    case BANK_IMM:
+                        insn.q1 &= 1;
+                        break;
+                }
+                
+                program.code.push_back(insn);
+            }
+            
+            return program;
+        }
+        
+        // executes one program on both models, returns the first point where they disagree
+        std::optional<divergence> check(const fuzz_program& program)
+        {
+            load(program);
+            
+            for (auto count = std::uint64_t{ 0 }; count < instruction_budget; ++count)
+            {
+                const auto pc = golden->state.pc;
+                const auto opcode = golden->memory[pc];
+                
+                // code overwritten by stores can reach an instruction the golden model knows but this board has no row for
+                if (length[opcode] == 0)
+                {
+                    break;
+                }
+                
+                golden->state.cycles = sim->state.cycles + layout::fetch_steps;
+                
+                if (golden->step() == golden_model<encoding, layout::stack_grows_up, layout::halt_sets_flags>::outcome::undefined)
+                {
+                    break;
+                }
+                
+                ++instructions;
+                ++executed[opcode];
+                
+                // the fetch of the next instruction is step 0, the row ends when the sequencer wraps back to it
+                auto steps = 0u;
+                
+                do
+                {
+                    sim->resume();
+                    sim->clock();
+                }
+                while (sim->state.step != 0 && ++steps < layout::width);
+                
+                if (const auto field = compare())
+                {
+                    const auto& [name, expected, actual] = *field;
+                    return divergence{ count, pc, opcode, name, expected, actual, false };
+                }
+                
+                if (golden->state.halted && base(opcode) == BRK)
+                {
+                    break;
+                }
+                
+                golden->state.halted = false;
+            }
+            
+            // stores to addresses the golden model never touched only show up here
+            if (const auto mismatch = std::mismatch(golden->memory.begin(), golden->memory.end(), sim->memory.begin()); mismatch.first != golden->memory.end())
+            {
+                const auto address = static_cast<std::uint16_t>(mismatch.first - golden->memory.begin());
+                return divergence{ 0, address, 0, "memory", *mismatch.first, *mismatch.second, true };
+            }
+            
+            return std::nullopt;
+        }
+        
+        // greedily drops instructions while the program still diverges
+        fuzz_program minimise(fuzz_program program)
+        {
+            for (auto changed = true; changed; )
+            {
+                changed = false;
+                
+                for (auto i = program.code.size(); i-- > 0; )
+                {
+                    auto candidate = program;
+                    candidate.code.erase(candidate.code.begin() + static_cast<std::ptrdiff_t>(i));
+                    
+                    for (auto& insn : candidate.code)
+                    {
+                        if (insn.target != fuzz_program::npos && insn.target > i)
+                        {
+                            --insn.target;
+                        }
+                    }
+                    
+                    if (check(candidate))
+                    {
+                        program = std::move(candidate);
+                        changed = true;
+                    }
+                }
+            }
+            
+            return program;
+        }
+        
+        void print(const fuzz_program& program) const noexcept
+        {
+            const auto addresses = layout_of(program);
+            
+            for (auto i = std::size_t{ 0 }; i < program.code.size(); ++i)
+            {
+                const auto& insn = program.code[i];
+                const auto trap = is_trap_row(insn.opcode, encoding);
+                
+                std::fprintf(stdout, "    %04X  %02X  %s%s", addresses[i], insn.opcode, trap ? "TRAP " : "", mnemonic(base(insn.opcode)));
+                
+                if (insn.target != fuzz_program::npos) std::fprintf(stdout, " %04X\n", addresses[insn.target]);
+                else if (length[insn.opcode] == 3)     std::fprintf(stdout, " %02X%02X\n", insn.q2, insn.q1);
+                else if (length[insn.opcode] == 2)     std::fprintf(stdout, " %02X\n", insn.q1);
+                else                                   std::fprintf(stdout, "\n");
+            }
+            
+            std::fprintf(stdout, "    %04X  %02X  BRK\n", addresses.back(), BRK);
+        }
+        
+        const std::vector<std::uint8_t>& valid_opcodes(void) const noexcept
+        {
+            return opcodes;
+        }
+    
+    private:
+        std::unique_ptr<simulator<encoding, layout>> sim;
+        std::unique_ptr<golden_model<encoding, layout::stack_grows_up, layout::halt_sets_flags>> golden;
+        
+        std::vector<std::uint8_t> opcodes{};
+        std::array<std::uint8_t, 0x100> length{};
+        
+        static constexpr unsigned int base(std::uint8_t opcode) noexcept
+        {
+            return row_opcode(opcode, encoding);
+        }
+        
+        // start address of every instruction plus the BRK appended after the last one
+        std::vector<std::uint16_t> layout_of(const fuzz_program& program) const
+        {
+            auto addresses = std::vector<std::uint16_t>{};
+            auto address = std::uint16_t{ 0 };
+            
+            for (const auto& insn : program.code)
+            {
+                addresses.push_back(address);
+                address += length[insn.opcode];
+            }
+            
+            addresses.push_back(address);
+            return addresses;
+        }
+        
+        void load(const fuzz_program& program)
+        {
+            const auto addresses = layout_of(program);
+            auto& memory = golden->memory;
+            
+            memory.fill(0);
+            std::copy(program.data.begin(), program.data.end(), memory.begin() + fuzz_program::data_base);
+            
+            for (auto i = std::size_t{ 0 }; i < program.code.size(); ++i)
+            {
+                const auto& insn = program.code[i];
+                const auto target = (insn.target != fuzz_program::npos) ? addresses[insn.target] : std::uint16_t{ 0 };
+                
+                memory[addresses[i]] = insn.opcode;
+                if (length[insn.opcode] > 1) memory[addresses[i] + 1] = (insn.target != fuzz_program::npos) ? static_cast<std::uint8_t>(target) : insn.q1;
+                if (length[insn.opcode] > 2) memory[addresses[i] + 2] = (insn.target != fuzz_program::npos) ? static_cast<std::uint8_t>(target >> 8) : insn.q2;
+            }
+            
+            memory[addresses.back()] = BRK;
+            
+            golden->state = isa_state{};
+            golden->banks.clear();
+            sim->memory = memory;
+            sim->banks.clear();
+            sim->state = machine_state{};
+            sim->reset();
+            
+            while (sim->state.step != 0)
+            {
+                sim->clock();
+            }
+        }
+        
+        struct field
+        {
+            const char* name;
+            unsigned int golden, simulated;
+        };
+        
+        std::optional<field> compare(void) const noexcept
+        {
+            const auto& g = golden->state;
+            const auto& s = sim->state;
+            
+#define COMPARE(name, x, y) if ((x) != (y)) return field{ name, static_cast<unsigned int>(x), static_cast<unsigned int>(y) };
+            COMPARE("a", g.r[REG_A], s.a)
+            COMPARE("b", g.r[REG_B], s.b)
+            COMPARE("c", g.r[REG_C], s.c)
+            COMPARE("d", g.r[REG_D], s.d)
+            COMPARE("f", g.r[REG_F], s.f)
+            COMPARE("pc", g.pc, s.pc)
+            COMPARE("sp", g.sp, s.sp)
+            COMPARE("halted", g.halted, s.halted)
+            COMPARE("interrupt enable", g.int_enable, s.int_enable)
+            
+            if constexpr (encoding == trap_encoding::mode_flag)
+            {
+                COMPARE("step mode", g.step_mode, s.step_mode)
+                COMPARE("bank", g.bank, s.bank)
+                COMPARE("retired", g.retired, s.retired)
+                COMPARE("counter hold", g.counter_hold, s.counter_hold)
+            }
+            
+            for (auto i = std::size_t{ 0 }; i < golden->writes; ++i)
+            {
+                const auto address = golden->written[i];
+                COMPARE("stored byte", golden->banks[address], sim->banks[address])
+            }
+#undef COMPARE
+            
+            return std::nullopt;
+        }
+    };
+    
+    // opcode_bit only: traps on the instructions that set C and Z, then branches on them, trapped and not; random programs
+    // seldom line that up, and it is where a board that keeps its halt latch in F behaves differently
+    inline fuzz_program single_step_program(void)
+    {
+        constexpr auto TRAP = 0x80;
+        constexpr auto npos = fuzz_program::npos;
+        
+        auto program = fuzz_program{};
+        
+        program.code =
+        {
+            { LDB_A_IMM, 0x01, 0, npos },
+            { SBB_A_IMM | TRAP, 0x01, 0, npos }, //Z
+            { JEZ_MEM | TRAP, 0, 0, 4 },
+            { LDB_B_IMM, 0x5A, 0, npos },
+            { LDB_C_IMM, 0xFF, 0, npos },
+            { ADC_C_IMM | TRAP, 0x01, 0, npos }, //C and Z
+            { JCS_MEM, 0, 0, 8 },
+            { LDB_D_IMM, 0xA5, 0, npos },
+            { AND_D_IMM | TRAP, 0x00, 0, npos }, //Z
+            { JEZ_MEM, 0, 0, 11 },
+            { LDB_B_IMM, 0xC3, 0, npos },
+            { MVB_A_F, 0, 0, npos },
+        };
+        
+        return program;
+    }
+    
+    template<trap_encoding encoding, typename layout>
+    int report_divergence(differential_tester<encoding, layout>& tester, const fuzz_program& program) noexcept
+    {
+        const auto where = *tester.check(program);
+        
+        tester.print(program);
+        
+        if (where.at_end)
+        {
+            std::fprintf(stdout, "[Divergence] memory at %04X after the program stopped: golden=%02X simulator=%02X\n",
+                         where.pc, where.golden, where.simulated);
+        }
+        
+        else
+        {
+            std::fprintf(stdout, "[Divergence] instruction %llu at %04X (%s): %s golden=%02X simulator=%02X\n",
+                         static_cast<unsigned long long>(where.instruction), where.pc, mnemonic(row_opcode(where.opcode, encoding)),
+                         where.field, where.golden, where.simulated);
+        }
+        
+        return EXIT_FAILURE;
+    }
+    
+    template<trap_encoding encoding, typename layout>
+    int run_fuzz(const fuzz_options& options) noexcept
+    {
+        static constexpr auto& µcode = decoded_µcode<encoding, layout>;
+        
+        const auto threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+        
+        auto next = std::atomic<std::uint64_t>{ 0 };
+        auto failed = std::atomic<bool>{ false };
+        auto lock = std::mutex{};
+        
+        auto instructions = std::uint64_t{ 0 };
+        auto executed = std::array<std::uint64_t, 0x100>{};
+        auto failure = std::optional<std::uint64_t>{};
+        
+        auto tester = differential_tester<encoding, layout>(µcode);
+        
+        if constexpr (encoding == trap_encoding::opcode_bit)
+        {
+            if (tester.check(single_step_program()))
+            {
+                std::fprintf(stdout, "[Divergence] single-stepped branches\n");
+                return report_divergence(tester, single_step_program());
+            }
+            
+            std::fprintf(stdout, "[Fuzz] single-stepped branches agree\n");
+        }
+        
+        const auto start = std::chrono::steady_clock::now();
+        
+        const auto worker = [&]
+        {
+            auto tester = differential_tester<encoding, layout>(µcode);
+            
+            for (auto index = next++; index < options.programs && !failed; index = next++)
+            {
+                if (tester.check(tester.generate(options.seed + index)))
+                {
+                    const auto guard = std::lock_guard(lock);
+                    
+                    failed = true;
+                    failure = std::min(failure.value_or(index), index);
+                }
+            }
+            
+            const auto guard = std::lock_guard(lock);
+            
+            instructions += tester.instructions;
+            
+            for (auto i = std::size_t{ 0 }; i < executed.size(); ++i)
+            {
+                executed[i] += tester.executed[i];
+            }
+        };
+        
+        auto pool = std::vector<std::thread>{};
+        
+        for (auto i = 0u; i < threads; ++i)
+        {
+            pool.emplace_back(worker);
+        }
+        
+        for (auto& thread : pool)
+        {
+            thread.join();
+        }
+        
+        const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        std::fprintf(stdout, "[Fuzz] %llu instructions on %u threads in %.2f s, %.2f M instructions/s\n",
+                     static_cast<unsigned long long>(instructions), threads, seconds, instructions / seconds / 1e6);
+        
+        if (failure)
+        {
+            const auto program = tester.minimise(tester.generate(options.seed + *failure));
+            
+            std::fprintf(stdout, "[Divergence] program %llu, minimised to %zu instructions\n",
+                         static_cast<unsigned long long>(options.seed + *failure), program.code.size());
+            
+            return report_divergence(tester, program);
+        }
+        
+        auto uncovered = 0u;
+        
+        for (const auto opcode : tester.valid_opcodes())
+        {
+            uncovered += (executed[opcode] == 0);
+        }
+        
+        std::fprintf(stdout, "[Fuzz] %llu programs agree, %zu/%zu opcodes covered\n",
+                     static_cast<unsigned long long>(options.programs), tester.valid_opcodes().size() - uncovered, tester.valid_opcodes().size());
+        
+        return EXIT_SUCCESS;
+    }
+}
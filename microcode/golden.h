@@ -0,0 +1,345 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <array>
+
+#include "microcode.h"
+#include "banks.h"
+
+namespace
+{
+    constexpr const char* mnemonic(unsigned int opcode) noexcept
+    {
+        switch (opcode)
+        {
+#define MNEMONIC(op) case op: return #op;
+            ISA_BASE(MNEMONIC)
+            ISA_POINTER(MNEMONIC)
+            ISA_INTERRUPT(MNEMONIC)
+            ISA_EXTENDED(MNEMONIC)
+#undef MNEMONIC
+            default: return "???";
+        }
+    }
+    
+    enum : std::size_t
+    {
+        REG_A, REG_B, REG_C, REG_D, REG_F,
+    };
+    
+    // what a program can observe, independent of how the datapath gets there
+    struct isa_state
+    {
+        std::array<std::uint8_t, 5> r{};
+        std::uint16_t pc = 0, sp = 0;
+        std::uint8_t bank = 0;
+        
+        // cycles has no meaning at this level, whoever drives the model sets it to the cycle of the instruction's first execute step
+        std::uint64_t cycles = 0, retired = 0;
+        std::uint32_t counter_hold = 0;
+        
+        bool halted = false, step_mode = false, int_enable = false;
+    };
+    
+    // instruction-level interpreter written from the mnemonics alone, the reference the microcode is checked against
+    template<trap_encoding encoding = trap_encoding::opcode_bit, bool stack_grows_up = false, bool halt_sets_flags = false>
+    class golden_model
+    {
+    public:
+        enum class outcome
+        {
+            retired,
+            undefined, //no such instruction in this encoding, nothing was executed
+        };
+        
+        isa_state state{};
+        std::array<std::uint8_t, 0x10000> memory{};
+        
+        // loads and stores through a pointer or an absolute operand go through the bank, the stack and code stay flat
+        bank_memory banks{ memory.data() };
+        
+        // physical addresses stored to by the last instruction
+        std::array<std::uint32_t, 2> written{};
+        std::size_t writes = 0;
+        
+        outcome step(void) noexcept
+        {
+            auto& r = state.r;
+            
+            const auto opcode = memory[state.pc];
+            const auto q1 = memory[static_cast<std::uint16_t>(state.pc + 1)];
+            const auto q2 = memory[static_cast<std::uint16_t>(state.pc + 2)];
+            const auto address = static_cast<std::uint16_t>(q1 | (q2 << 8));
+            
+            const auto trap = is_trap_row(opcode, encoding);
+            const auto op = row_opcode(opcode, encoding);
+            
+            auto next = static_cast<std::uint16_t>(state.pc + 1);
+            writes = 0;
+            
+            switch (op)
+            {
+                case NOP:
+                    break;
+                
+                case BRK:
+                    if (trap) return outcome::undefined;
+                    state.halted = true;
+                    break;
+                    
+#define MVB(x, y) case MVB_##x##_##y: r[REG_##x] = r[REG_##y]; break;
+#define ALUR(x, y) case ADC_##x##_##y: r[REG_##x] = adc(r[REG_##x], r[REG_##y]); break; \
+                   case SBB_##x##_##y: r[REG_##x] = sbb(r[REG_##x], r[REG_##y]); break; \
+                   case AND_##x##_##y: r[REG_##x] = logic(r[REG_##x] & r[REG_##y]); break; \
+                   case LOR_##x##_##y: r[REG_##x] = logic(r[REG_##x] | r[REG_##y]); break;
+#define ALUI(x) case ADC_##x##_IMM: r[REG_##x] = adc(r[REG_##x], q1); next += 1; break; \
+                case SBB_##x##_IMM: r[REG_##x] = sbb(r[REG_##x], q1); next += 1; break; \
+                case AND_##x##_IMM: r[REG_##x] = logic(r[REG_##x] & q1); next += 1; break; \
+                case LOR_##x##_IMM: r[REG_##x] = logic(r[REG_##x] | q1); next += 1; break; \
+                case ROL_##x##_IMM: r[REG_##x] = logic(rotate(r[REG_##x], q1 & 7)); next += 1; break; \
+                case ROR_##x##_IMM: r[REG_##x] = logic(rotate(r[REG_##x], (8 - (q1 & 7)) & 7)); next += 1; break; \
+                case NOT_##x: r[REG_##x] = logic(~r[REG_##x]); break;
+#define LDST(x) case LDB_##x##_IMM: r[REG_##x] = q1; next += 1; break; \
+                case LDB_##x##_MEM: r[REG_##x] = banks[data(address)]; next += 2; break; \
+                case STB_MEM_##x: store(data(address), r[REG_##x]); next += 2; break; \
+                case PUSH_##x: push(r[REG_##x]); break; \
+                case POP_##x: r[REG_##x] = pop(); break;
+                
+                MVB(A, B) MVB(A, C) MVB(A, D) MVB(A, F)
+                MVB(B, A) MVB(B, C) MVB(B, D) MVB(B, F)
+                MVB(C, A) MVB(C, B) MVB(C, D) MVB(C, F)
+                MVB(D, A) MVB(D, B) MVB(D, C) MVB(D, F)
+                
+                ALUR(A, B) ALUR(A, C) ALUR(A, D)
+                ALUR(B, A) ALUR(B, C) ALUR(B, D)
+                ALUR(C, A) ALUR(C, B) ALUR(C, D)
+                ALUR(D, A) ALUR(D, B) ALUR(D, C)
+                
+                ALUI(A) ALUI(B) ALUI(C) ALUI(D)
+                LDST(A) LDST(B) LDST(C) LDST(D)
+#undef MVB
+#undef ALUR
+#undef ALUI
+#undef LDST
+                
+                // the pushed address is the PUSH_IP itself, POP_IP resumes just past it
+                case PUSH_IP:
+                    push(static_cast<std::uint8_t>(state.pc >> 8));
+                    push(static_cast<std::uint8_t>(state.pc));
+                    break;
+                
+                case POP_IP:
+                    next = static_cast<std::uint16_t>(pop16() + 1);
+                    break;
+                
+                case JEZ_MEM:
+                    next = (r[REG_F] & FLAG_Z) ? address : static_cast<std::uint16_t>(next + 2);
+                    break;
+                
+                case JCS_MEM:
+                    next = (r[REG_F] & FLAG_C) ? address : static_cast<std::uint16_t>(next + 2);
+                    break;
+                
+                case JMP_MEM:
+                    next = address;
+                    break;
+                
+                case DEREF_AB_A:
+                    r[REG_A] = banks[data(pointer(REG_A, REG_B))];
+                    break;
+                
+                case DEREF_CD_C:
+                    r[REG_C] = banks[data(pointer(REG_C, REG_D))];
+                    break;
+                    
+#define PTR(p, lo, hi, x) case DEREF_##p##_##x##_INC: r[REG_##x] = banks[data(advance(REG_##lo, REG_##hi, 0, +1))]; break; \
+                          case DEREF_##p##_##x##_DEC: r[REG_##x] = banks[data(advance(REG_##lo, REG_##hi, -1, 0))]; break; \
+                          case STORE_##p##_##x##_INC: store(data(advance(REG_##lo, REG_##hi, 0, +1)), r[REG_##x]); break; \
+                          case STORE_##p##_##x##_DEC: store(data(advance(REG_##lo, REG_##hi, -1, 0)), r[REG_##x]); break;
+                PTR(AB, A, B, C)
+                PTR(CD, C, D, A)
+#undef PTR
+                
+                case EI: state.int_enable = true; break;
+                case DI: state.int_enable = false; break;
+                
+                case RETI:
+                    r[REG_F] = pop();
+                    next = pop16();
+                    state.int_enable = true;
+                    break;
+                
+                default:
+                    if constexpr (encoding == trap_encoding::mode_flag)
+                    {
+                        if (extended(op, next)) break;
+                    }
+                    
+                    return outcome::undefined;
+            }
+            
+            state.pc = next;
+            ++state.retired;
+            
+            if (trap || state.step_mode)
+            {
+                state.halted = true;
+            }
+            
+            // a board that keeps its halt latch in F overwrites the flags on every stop, jumps above saw them first
+            if (halt_sets_flags && state.halted)
+            {
+                r[REG_F] = FLAG_H;
+            }
+            
+            return outcome::retired;
+        }
+    
+    private:
+        bool extended(unsigned int op, std::uint16_t& next) noexcept
+        {
+            auto& r = state.r;
+            
+            const auto q1 = memory[static_cast<std::uint16_t>(state.pc + 1)];
+            
+            switch (op)
+            {
+                case STEP_ON:  state.step_mode = true; return true;
+                case STEP_OFF: state.step_mode = false; return true;
+                
+                case BANK_A:
+                    state.bank = r[REG_A];
+                    return true;
+                
+                case BANK_IMM:
+                    state.bank = q1;
+                    next += 1;
+                    return true;
+                
+                // stack-relative accesses ignore the bank, like the stack itself
+#define SPREL(x) case LDB_##x##_SP: r[REG_##x] = memory[local(q1)]; next += 1; return true; \
+                 case STB_SP_##x: store(local(q1), r[REG_##x]); next += 1; return true;
+                SPREL(A)
+                SPREL(B)
+                SPREL(C)
+                SPREL(D)
+#undef SPREL
+                
+#define COUNTER(x, lo, hi) case RDCYC_##x: read_counter(state.cycles, REG_##lo, REG_##hi); return true; \
+                           case RDINS_##x: read_counter(state.retired, REG_##lo, REG_##hi); return true; \
+                           case RDHI_##x: r[REG_##lo] = drain(); r[REG_##hi] = drain(); return true;
+                COUNTER(AB, A, B)
+                COUNTER(CD, C, D)
+#undef COUNTER
+                
+                default:
+                    return false;
+            }
+        }
+        
+        std::uint32_t data(std::uint16_t address) const noexcept
+        {
+            return (std::uint32_t{ state.bank } << 16) | address;
+        }
+        
+        // the low byte comes straight from the counter, the rest is held so a pair of reads sees one value
+        void read_counter(std::uint64_t counter, std::size_t lo, std::size_t hi) noexcept
+        {
+            state.r[lo] = static_cast<std::uint8_t>(counter);
+            state.counter_hold = static_cast<std::uint32_t>(counter) >> 8;
+            state.r[hi] = drain();
+        }
+        
+        std::uint8_t drain(void) noexcept
+        {
+            const auto byte = static_cast<std::uint8_t>(state.counter_hold);
+            state.counter_hold >>= 8;
+            return byte;
+        }
+        
+        std::uint16_t local(std::uint8_t offset) const noexcept
+        {
+            return static_cast<std::uint16_t>(state.sp + offset);
+        }
+        
+        std::uint16_t pointer(std::size_t lo, std::size_t hi) const noexcept
+        {
+            return static_cast<std::uint16_t>(state.r[lo] | (state.r[hi] << 8));
+        }
+        
+        // applies the pre-adjustment, returns the address to access and writes back the post-adjusted pointer
+        std::uint16_t advance(std::size_t lo, std::size_t hi, int before, int after) noexcept
+        {
+            const auto access = static_cast<std::uint16_t>(pointer(lo, hi) + before);
+            const auto updated = static_cast<std::uint16_t>(access + after);
+            
+            state.r[lo] = static_cast<std::uint8_t>(updated);
+            state.r[hi] = static_cast<std::uint8_t>(updated >> 8);
+            
+            return access;
+        }
+        
+        // pushes move the stack pointer first, pops read before moving it back
+        void push(std::uint8_t value) noexcept
+        {
+            store(stack_grows_up ? ++state.sp : --state.sp, value);
+        }
+        
+        std::uint8_t pop(void) noexcept
+        {
+            return memory[stack_grows_up ? state.sp-- : state.sp++];
+        }
+        
+        std::uint16_t pop16(void) noexcept
+        {
+            const auto lo = pop();
+            const auto hi = pop();
+            
+            return static_cast<std::uint16_t>(lo | (hi << 8));
+        }
+        
+        void store(std::uint32_t address, std::uint8_t value) noexcept
+        {
+            banks[address] = value;
+            
+            if (writes < written.size())
+            {
+                written[writes++] = address;
+            }
+        }
+        
+        std::uint8_t flags(unsigned int result, bool carry) noexcept
+        {
+            const auto value = static_cast<std::uint8_t>(result);
+            
+            state.r[REG_F] = static_cast<std::uint8_t>((state.r[REG_F] & ~(FLAG_C | FLAG_Z)) | (carry ? FLAG_C : 0) | (value ? 0 : FLAG_Z));
+            
+            return value;
+        }
+        
+        std::uint8_t adc(unsigned int a, unsigned int b) noexcept
+        {
+            const auto sum = a + b + ((state.r[REG_F] & FLAG_C) ? 1 : 0);
+            return flags(sum, sum > 0xFF);
+        }
+        
+        std::uint8_t sbb(unsigned int a, unsigned int b) noexcept
+        {
+            const auto borrow = b + ((state.r[REG_F] & FLAG_C) ? 1 : 0);
+            return flags(a - borrow, a < borrow);
+        }
+        
+        // logic and rotates always clear carry
+        std::uint8_t logic(unsigned int result) noexcept
+        {
+            return flags(result & 0xFF, false);
+        }
+        
+        static constexpr unsigned int rotate(unsigned int value, unsigned int count) noexcept
+        {
+            return ((value << count) | (value >> (8 - count))) & 0xFF;
+        }
+    };
+}
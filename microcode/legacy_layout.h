@@ -0,0 +1,319 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "microcode.h"
+
+namespace
+{
+    // control word of the first board revision (see main.cpp.old.cpp)
+    namespace legacy
+    {
+        consteval auto IMM(µcode_type x) noexcept
+        {
+            return (x << 56);
+        }
+        
+        enum : µcode_type
+        {
+            IMMEDIATE_IN = BIT(55),
+            LSU_STACK_ENABLE = BIT(54),
+            
+            EAU_ADDRESS_BUS_IN = BIT(53), //not in Logisim design
+            EAU_DATA_BUS_OUT = BIT(52),   //^
+            
+            REQUEST_JUMP = BIT(51),       //^
+            
+            
+            JUMP_GREATER_THAN_ZERO = BIT(45),
+            JUMP_CARRY_SET         = BIT(44),
+            JUMP_ON_ZERO           = BIT(43),
+            
+            PCU_INSTRUCTION_REGISTER_IN = BIT(42),
+            
+            RF_TEMP_OUT = BIT(41),
+            RF_TEMP_IN  = BIT(40),
+            
+            CONNECT_F_TO_DATA_BUS = BIT(39),
+            
+            PC_LOAD_VALUE               = BIT(38),
+            PC_ENABLE                   = BIT(37), //should be unused
+            PC_SKIP_TO_NEXT_INSTRUCTION = BIT(36),
+            PC_ADDRESS_BUS_OUT          = BIT(35),
+            PC_ADDRESS_BUS_IN           = BIT(34),
+            
+            EAU_ADDRESS_BUS_OUT = BIT(33),
+            EAU_DATA_BUS_IN     = BIT(32),
+            EAU_LO_SELECT       = BIT(31),
+            EAU_HI_SELECT       = BIT(30),
+            
+            LSU_FLAGS_OUT               = BIT(29),
+            LSU_WRITE_ENABLE            = BIT(28),
+            LSU_READ_ENABLE             = BIT(27),
+            LSU_RAM_ENABLE              = BIT(26),
+            LSU_ROM_ENABLE              = BIT(25),
+            LSU_DECREMENT_STACK_POINTER = BIT(24),
+            LSU_INCREMENT_STACK_POINTER = BIT(23),
+            
+            ALU_ROTATE_RIGHT = BIT(22),
+            ALU_ROTATE_LEFT  = BIT(21),
+            ALU_NOT          = BIT(20),
+            ALU_OR           = BIT(19),
+            ALU_AND          = BIT(18),
+            ALU_SUBTRACTION  = BIT(17),
+            ALU_ADDITION     = BIT(16),
+            
+            ALU_WRITE_A   = BIT(15),
+            ALU_WRITE_B   = BIT(14),
+            ALU_WRITE_F   = BIT(13),
+            ALU_WRITE_OUT = BIT(12),
+            ALU_OUT       = BIT(11),
+            ALU_IN        = BIT(10),
+            
+            RF_FLAGS_OUT = BIT(9),
+            RF_D_OUT     = BIT(8),
+            RF_C_OUT     = BIT(7),
+            RF_B_OUT     = BIT(6),
+            RF_A_OUT     = BIT(5),
+            
+            RF_FLAGS_IN = BIT(4),
+            RF_D_IN     = BIT(3),
+            RF_C_IN     = BIT(2),
+            RF_B_IN     = BIT(1),
+            RF_A_IN     = BIT(0),
+        };
+        
+        constexpr const auto FETCH_ROM_DATA = PC_ADDRESS_BUS_OUT | LSU_ROM_ENABLE | LSU_READ_ENABLE,
+                                 FETCH_INSN = FETCH_ROM_DATA | PCU_INSTRUCTION_REGISTER_IN,
+                          PC_INCREMENT_BOTH = PC_LOAD_VALUE | PC_SKIP_TO_NEXT_INSTRUCTION,
+                                   BRK_FLAG = IMMEDIATE_IN | IMM(FLAG_H) | CONNECT_F_TO_DATA_BUS | RF_FLAGS_IN;
+    }
+    
+    // only produced by decoding: latch the ALU result for a later ALU_OE, as the first board does
+    constexpr const auto ALU_HOLD = BIT(48);
+    
+    // only produced by decoding: the immediate FLAG_H the first board drives into F when it halts
+    constexpr const auto DRIVE_FLAG_H = BIT(49);
+    
+    // reached during constant evaluation only when a line cannot be expressed, which fails the build
+    inline void legacy_layout_cannot_express_line(void) noexcept
+    {
+    }
+    
+    struct legacy_layout
+    {
+        static constexpr const auto id = std::uint8_t{ 1 };
+        static constexpr const auto unsupported = ACU_INC | ACU_DEC | ACU_BANK | ACU_LD | ACU_ADD | CNT_OL | CNT_OH | CNT_SEL | PC_VEC | LSU_SP_LD | INT_EI | INT_DI | SET_STEP | CLR_STEP;
+        static constexpr const auto has_reset_row = false, latched_alu = true, shared_address_unit = true, stack_grows_up = true;
+        static constexpr const auto fetch_overlap = false, separate_address_bus = true, flag_addressed = false, halt_sets_flags = true;
+        
+        static constexpr const auto width = std::size_t{ µcode_line_width }, rows = std::size_t{ 0x100 }, fetch_steps = std::size_t{ 1 };
+        
+        static constexpr const auto ALU_OPS = ALU_ADD | ALU_SUB | ALU_AND | ALU_OR | ALU_NOT | ALU_SHL | ALU_SHR;
+        
+        // one step to one step, operand and ALU steps are split beforehand by translate()
+        static constexpr µcode_type map(µcode_type µop) noexcept
+        {
+            if (µop & unsupported)
+            {
+                legacy_layout_cannot_express_line();
+            }
+            
+            auto out = µcode_type{ 0 };
+            
+            const auto pass = [&](µcode_type from, µcode_type to)
+            {
+                out |= (µop & from) ? to : 0;
+            };
+            
+            pass(RF_AI, legacy::RF_A_IN);
+            pass(RF_BI, legacy::RF_B_IN);
+            pass(RF_CI, legacy::RF_C_IN);
+            pass(RF_DI, legacy::RF_D_IN);
+            pass(RF_FI, legacy::RF_FLAGS_IN);
+            
+            pass(RF_AO, legacy::RF_A_OUT);
+            pass(RF_BO, legacy::RF_B_OUT);
+            pass(RF_CO, legacy::RF_C_OUT);
+            pass(RF_DO, legacy::RF_D_OUT);
+            pass(RF_FO, legacy::RF_FLAGS_OUT);
+            pass(CONNECT_FB, legacy::CONNECT_F_TO_DATA_BUS);
+            
+            // the first board selects ROM or RAM explicitly, and its stack grows upwards
+            pass(LSU_RE, legacy::LSU_READ_ENABLE);
+            pass(LSU_WE, legacy::LSU_WRITE_ENABLE);
+            pass(LSU_SP_EN, legacy::LSU_STACK_ENABLE);
+            
+            if (µop & (LSU_RE | LSU_WE))
+            {
+                out |= (µop & PC_OE) ? legacy::LSU_ROM_ENABLE : legacy::LSU_RAM_ENABLE;
+            }
+            
+            if (µop & LSU_SP_WE)
+            {
+                out |= (µop & LSU_SP_D) ? legacy::LSU_INCREMENT_STACK_POINTER : legacy::LSU_DECREMENT_STACK_POINTER;
+            }
+            
+            pass(ALU_ADD, legacy::ALU_ADDITION);
+            pass(ALU_SUB, legacy::ALU_SUBTRACTION);
+            pass(ALU_AND, legacy::ALU_AND);
+            pass(ALU_OR,  legacy::ALU_OR);
+            pass(ALU_NOT, legacy::ALU_NOT);
+            pass(ALU_SHL, legacy::ALU_ROTATE_LEFT);
+            pass(ALU_SHR, legacy::ALU_ROTATE_RIGHT);
+            pass(ALU_WA, legacy::ALU_WRITE_A | legacy::ALU_IN | legacy::RF_FLAGS_OUT | legacy::ALU_WRITE_F);
+            pass(ALU_WB, legacy::ALU_WRITE_B | legacy::ALU_IN);
+            pass(ALU_OE, legacy::ALU_OUT);
+            
+            pass(IR_WE, legacy::PCU_INSTRUCTION_REGISTER_IN);
+            
+            pass(PC_OE, legacy::PC_ADDRESS_BUS_OUT);
+            pass(PC_INI, legacy::PC_SKIP_TO_NEXT_INSTRUCTION);
+            pass(PC_LRC, legacy::PC_ADDRESS_BUS_IN | legacy::PC_LOAD_VALUE);
+            pass(FORCE_JUMP, legacy::REQUEST_JUMP);
+            pass(REQUEST_JEZ, legacy::JUMP_ON_ZERO);
+            pass(REQUEST_JCS, legacy::JUMP_CARRY_SET);
+            
+            // a single EAU register both composes and decomposes addresses
+            pass(ACU_WL, legacy::EAU_DATA_BUS_IN | legacy::EAU_LO_SELECT);
+            pass(ACU_WH, legacy::EAU_DATA_BUS_IN | legacy::EAU_HI_SELECT);
+            pass(ACU_OE, legacy::EAU_ADDRESS_BUS_OUT);
+            pass(ADU_WE, legacy::EAU_ADDRESS_BUS_IN);
+            pass(ADU_RL, legacy::EAU_DATA_BUS_OUT | legacy::EAU_LO_SELECT);
+            pass(ADU_RH, legacy::EAU_DATA_BUS_OUT | legacy::EAU_HI_SELECT);
+            
+            pass(SET_HALT, legacy::BRK_FLAG);
+            
+            return out;
+        }
+        
+        // operands are read through the PC rather than Q1/Q2, and the ALU needs a step to latch its result,
+        // so one step of this board can become two of the first one
+        static constexpr µcode_line translate(const µcode_line& µinsn) noexcept
+        {
+            auto out = µcode_line{};
+            auto n = std::size_t{ 0 };
+            
+            const auto put = [&](µcode_type µop)
+            {
+                if (n == µcode_line_width)
+                {
+                    legacy_layout_cannot_express_line();
+                }
+                
+                else
+                {
+                    out[n++] = µop;
+                }
+            };
+            
+            for (const auto µop : µinsn)
+            {
+                if (µop == 0)
+                {
+                    continue;
+                }
+                
+                // LEN is meaningless here since every operand fetch already moved the PC
+                const auto signals = µop & ~LEN(3);
+                
+                if (signals & (OUT_Q1 | OUT_Q2))
+                {
+                    put(legacy::PC_INCREMENT_BOTH);
+                    put(map((signals & ~(OUT_Q1 | OUT_Q2)) | PC_OE | LSU_RE));
+                }
+                
+                else if (signals & ALU_OE)
+                {
+                    put(map(signals & ALU_OPS) | legacy::ALU_IN | legacy::ALU_WRITE_OUT);
+                    put(map(signals & ~ALU_OPS));
+                }
+                
+                else
+                {
+                    put(map(signals));
+                }
+            }
+            
+            return out;
+        }
+        
+        // back to this board's signals for the simulator, every PC step of the first board is a single byte
+        static constexpr µcode_type decode(µcode_type µop) noexcept
+        {
+            if (µop == 0)
+            {
+                return 0;
+            }
+            
+            auto out = LEN(1);
+            
+            const auto all = [&](µcode_type mask)
+            {
+                return (µop & mask) == mask;
+            };
+            
+            const auto pass = [&](µcode_type from, µcode_type to)
+            {
+                out |= all(from) ? to : 0;
+            };
+            
+            // halting is a write of FLAG_H into F, which clears C and Z under whatever single-steps on this board
+            if (all(legacy::BRK_FLAG))
+            {
+                out |= SET_HALT | DRIVE_FLAG_H | RF_FI | CONNECT_FB;
+                µop &= ~legacy::BRK_FLAG;
+            }
+            
+            pass(legacy::RF_A_IN, RF_AI);
+            pass(legacy::RF_B_IN, RF_BI);
+            pass(legacy::RF_C_IN, RF_CI);
+            pass(legacy::RF_D_IN, RF_DI);
+            pass(legacy::RF_FLAGS_IN, RF_FI);
+            
+            pass(legacy::RF_A_OUT, RF_AO);
+            pass(legacy::RF_B_OUT, RF_BO);
+            pass(legacy::RF_C_OUT, RF_CO);
+            pass(legacy::RF_D_OUT, RF_DO);
+            pass(legacy::RF_FLAGS_OUT | legacy::CONNECT_F_TO_DATA_BUS, RF_FO);
+            pass(legacy::CONNECT_F_TO_DATA_BUS, CONNECT_FB);
+            
+            pass(legacy::LSU_READ_ENABLE, LSU_RE);
+            pass(legacy::LSU_WRITE_ENABLE, LSU_WE);
+            pass(legacy::LSU_STACK_ENABLE, LSU_SP_EN);
+            pass(legacy::LSU_INCREMENT_STACK_POINTER, LSU_SP_WE);
+            pass(legacy::LSU_DECREMENT_STACK_POINTER, LSU_SP_WE | LSU_SP_D);
+            
+            pass(legacy::ALU_ADDITION, ALU_ADD);
+            pass(legacy::ALU_SUBTRACTION, ALU_SUB);
+            pass(legacy::ALU_AND, ALU_AND);
+            pass(legacy::ALU_OR, ALU_OR);
+            pass(legacy::ALU_NOT, ALU_NOT);
+            pass(legacy::ALU_ROTATE_LEFT, ALU_SHL);
+            pass(legacy::ALU_ROTATE_RIGHT, ALU_SHR);
+            pass(legacy::ALU_WRITE_A | legacy::ALU_IN, ALU_WA);
+            pass(legacy::ALU_WRITE_B | legacy::ALU_IN, ALU_WB);
+            pass(legacy::ALU_WRITE_OUT | legacy::ALU_IN, ALU_HOLD);
+            pass(legacy::ALU_OUT, ALU_OE);
+            
+            pass(legacy::PCU_INSTRUCTION_REGISTER_IN, IR_WE);
+            
+            pass(legacy::PC_ADDRESS_BUS_OUT, PC_OE);
+            pass(legacy::PC_SKIP_TO_NEXT_INSTRUCTION, PC_INI);
+            pass(legacy::PC_ADDRESS_BUS_IN | legacy::PC_LOAD_VALUE, PC_LRC);
+            pass(legacy::REQUEST_JUMP, FORCE_JUMP);
+            pass(legacy::JUMP_ON_ZERO, REQUEST_JEZ);
+            pass(legacy::JUMP_CARRY_SET, REQUEST_JCS);
+            
+            pass(legacy::EAU_DATA_BUS_IN | legacy::EAU_LO_SELECT, ACU_WL);
+            pass(legacy::EAU_DATA_BUS_IN | legacy::EAU_HI_SELECT, ACU_WH);
+            pass(legacy::EAU_ADDRESS_BUS_OUT, ACU_OE);
+            pass(legacy::EAU_ADDRESS_BUS_IN, ADU_WE);
+            pass(legacy::EAU_DATA_BUS_OUT | legacy::EAU_LO_SELECT, ADU_RL);
+            pass(legacy::EAU_DATA_BUS_OUT | legacy::EAU_HI_SELECT, ADU_RH);
+            
+            return out;
+        }
+    };
+}
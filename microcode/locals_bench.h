@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "microcode.h"
+#include "simulator.h"
+#include "assembler.h"
+
+namespace
+{
+    // sum(n) = n + sum(n - 1) with n passed on the stack under the return address and the result in A;
+    // without stack-relative addressing every access to n pops the return address out of the way and pushes it back
+    inline assembler locals_by_shuffles(std::uint8_t n)
+    {
+        auto code = assembler{};
+        const auto sum = code.make_label(), done = code.make_label();
+        
+        code.emit(LDB_A_IMM, n).emit(PUSH_A).call(sum).emit(POP_B).emit(BRK);
+        
+        code.bind(sum);
+        code.emit(POP_C).emit(POP_D).emit(POP_A).emit(PUSH_A).emit(PUSH_D).emit(PUSH_C);
+        code.emit(AND_A_IMM, 0xFF).emit(JEZ_MEM, done);
+        code.emit(SBB_A_IMM, 1).emit(PUSH_A).call(sum).emit(POP_B);
+        code.emit(POP_C).emit(POP_D).emit(POP_B).emit(PUSH_B).emit(PUSH_D).emit(PUSH_C);
+        code.emit(AND_B_IMM, 0xFF).emit(ADC_A_B);
+        
+        code.bind(done);
+        code.emit(POP_C).emit(POP_D).emit(AND_C_IMM, 0xFF).emit(ADC_C_IMM, 3).emit(ADC_D_IMM, 0).emit(PUSH_D).emit(PUSH_C);
+        code.emit(POP_IP);
+        
+        return code;
+    }
+    
+    // the same routine reading n at SP+2 and stepping the return address at SP+0/1 in place
+    inline assembler locals_by_offsets(std::uint8_t n)
+    {
+        auto code = assembler{};
+        const auto sum = code.make_label(), done = code.make_label();
+        
+        code.emit(LDB_A_IMM, n).emit(PUSH_A).call(sum).emit(POP_B).emit(BRK);
+        
+        code.bind(sum);
+        code.emit(LDB_A_SP, 2);
+        code.emit(AND_A_IMM, 0xFF).emit(JEZ_MEM, done);
+        code.emit(SBB_A_IMM, 1).emit(PUSH_A).call(sum).emit(POP_B);
+        code.emit(LDB_B_SP, 2);
+        code.emit(AND_B_IMM, 0xFF).emit(ADC_A_B);
+        
+        code.bind(done);
+        code.emit(LDB_C_SP, 0).emit(AND_C_IMM, 0xFF).emit(ADC_C_IMM, 3).emit(STB_SP_C, 0).emit(LDB_C_SP, 1).emit(ADC_C_IMM, 0).emit(STB_SP_C, 1);
+        code.emit(POP_IP);
+        
+        return code;
+    }
+    
+    // stack-relative loads and stores only exist in the mode_flag encoding
+    template<typename layout>
+    int run_locals_bench(std::uint8_t n, std::uint64_t budget) noexcept
+    {
+        static constexpr auto& µcode = encoded_µcode<trap_encoding::mode_flag, layout>;
+        
+        const auto expected = static_cast<std::uint8_t>(n * (n + 1) / 2);
+        auto baseline = machine_state{};
+        auto failed = false;
+        
+        std::fprintf(stdout, "[Locals] sum(%u), recursion depth %u\n", n, n + 1u);
+        
+        for (const auto& [name, code] : { std::pair{ "shuffles", locals_by_shuffles(n) }, std::pair{ "sp+imm8", locals_by_offsets(n) } })
+        {
+            const auto image = code.link();
+            auto sim = std::make_unique<simulator<trap_encoding::mode_flag, layout>>(µcode);
+            
+            std::copy(image->begin(), image->end(), sim->memory.begin());
+            sim->run(budget);
+            
+            const auto& state = sim->state;
+            const auto correct = state.halted && state.ir == BRK && state.a == expected;
+            
+            if (baseline.retired == 0)
+            {
+                baseline = state;
+            }
+            
+            std::fprintf(stdout, "[Locals] %-8s %5zu bytes %8llu instructions %9llu cycles  %5.1f%% of the cycles  A=%02X %s\n", name, image->size(),
+                         static_cast<unsigned long long>(state.retired), static_cast<unsigned long long>(state.cycles),
+                         100.0 * static_cast<double>(state.cycles) / static_cast<double>(baseline.cycles), state.a, correct ? "" : "wrong");
+            
+            failed |= !correct;
+        }
+        
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+}
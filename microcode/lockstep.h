@@ -0,0 +1,335 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <array>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "microcode.h"
+#include "simulator.h"
+#include "rom_diff.h"
+
+namespace
+{
+    // lockstep comparison: the simulator sequences the microcode and hands every control word it executes to a second
+    // datapath model in another process, which answers with its register state after each word; both sides work a batch
+    // ahead of each other through a ring of slots in shared memory, so the ring is only synchronised once per batch.
+    // the built-in model is the simulator's own datapath, so this checks the sequencer/datapath split and the protocol;
+    // it only becomes a hardware check once --model names a process that drives real hardware or an HDL model
+    constexpr const auto lockstep_magic = std::uint32_t{ 0x4B434F4C }; //"LOCK"
+    constexpr const auto lockstep_version = std::uint32_t{ 1 };
+    constexpr const auto lockstep_batch_cycles = std::size_t{ 4096 };
+    constexpr const auto lockstep_slots = std::size_t{ 16 };
+    
+    // simulator to model: one control word as the board's signal lines see it
+    struct lockstep_word
+    {
+        µcode_type µop;
+        std::uint8_t retire; //the sequencer ends an instruction on this word, the retired counter steps
+        std::array<std::uint8_t, 7> reserved;
+    };
+    
+    // model to simulator: the datapath after the word, everything a datapath exposes without the sequencer
+#define LOCKSTEP_FIELDS(X) \
+    X(pc) X(sp) X(acu) X(adu) X(address) \
+    X(a) X(b) X(c) X(d) X(f) X(q1) X(q2) X(data) X(alu_a) X(alu_b)
+    
+    struct lockstep_state
+    {
+        std::uint16_t pc, sp, acu, adu, address;
+        std::uint8_t a, b, c, d, f, q1, q2, data, alu_a, alu_b;
+    };
+    
+    struct lockstep_slot
+    {
+        std::uint32_t count, reserved;
+        std::array<lockstep_word, lockstep_batch_cycles> words;
+        std::array<lockstep_state, lockstep_batch_cycles> states;
+    };
+    
+    // the shared segment, all fixed-width fields so a model in another language can map it; slot n % lockstep_slots carries batch n,
+    // which the simulator publishes by raising submitted past n and the model answers by raising completed past n
+    struct lockstep_ring
+    {
+        std::uint32_t magic, version, batch_cycles, slots;
+        std::atomic<std::uint64_t> submitted, completed;
+        std::atomic<std::uint32_t> shutdown;
+        std::uint32_t reserved;
+        std::array<std::uint8_t, 0x10000> memory; //the image both sides start from, registers start cleared
+        std::array<lockstep_slot, lockstep_slots> ring;
+    };
+    
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+                  "the ring counters are shared between processes and must not hide a lock");
+    
+    // the layout a model declares on its side, every byte named so neither compiler can pad it differently
+    static_assert(sizeof(std::atomic<std::uint64_t>) == 8 && sizeof(std::atomic<std::uint32_t>) == 4);
+    static_assert(sizeof(lockstep_word) == 16 && offsetof(lockstep_word, retire) == 8 && offsetof(lockstep_word, reserved) == 9);
+    static_assert(sizeof(lockstep_state) == 20 && offsetof(lockstep_state, address) == 8 && offsetof(lockstep_state, a) == 10 && offsetof(lockstep_state, alu_b) == 19);
+    static_assert(offsetof(lockstep_slot, words) == 8 && offsetof(lockstep_slot, states) == 8 + 16 * lockstep_batch_cycles &&
+                  sizeof(lockstep_slot) == 8 + 36 * lockstep_batch_cycles);
+    static_assert(offsetof(lockstep_ring, submitted) == 16 && offsetof(lockstep_ring, completed) == 24 && offsetof(lockstep_ring, shutdown) == 32 &&
+                  offsetof(lockstep_ring, memory) == 40 && offsetof(lockstep_ring, ring) == 40 + 0x10000 &&
+                  sizeof(lockstep_ring) == 40 + 0x10000 + sizeof(lockstep_slot) * lockstep_slots);
+    
+    template<typename machine>
+    lockstep_state capture(const machine& sim) noexcept
+    {
+        const auto& s = sim.state;
+        return { s.pc, s.sp, s.acu, s.adu, sim.bus.address, s.a, s.b, s.c, s.d, s.f, s.q1, s.q2, sim.bus.data, s.alu_a, s.alu_b };
+    }
+    
+    // the built-in model: the simulator's own datapath, driven only by the words in the ring
+    template<trap_encoding encoding, typename layout>
+    void lockstep_model(lockstep_ring& shared) noexcept
+    {
+        auto sim = std::make_unique<simulator<encoding, layout>>(decoded_µcode<encoding, layout>);
+        sim->memory = shared.memory;
+        
+        for (auto batch = std::uint64_t{ 0 }; ; ++batch)
+        {
+            while (shared.submitted.load(std::memory_order_acquire) <= batch)
+            {
+                if (shared.shutdown.load(std::memory_order_acquire))
+                {
+                    return;
+                }
+                
+                std::this_thread::yield();
+            }
+            
+            auto& slot = shared.ring[batch % lockstep_slots];
+            
+            for (auto i = std::size_t{ 0 }; i < slot.count; ++i)
+            {
+                sim->execute(slot.words[i].µop);
+                ++sim->state.cycles;
+                sim->state.retired += slot.words[i].retire;
+                
+                slot.states[i] = capture(*sim);
+            }
+            
+            shared.completed.store(batch + 1, std::memory_order_release);
+        }
+    }
+    
+    // what the simulator expects back for a word, kept on its side of the ring
+    struct lockstep_expectation
+    {
+        lockstep_state state;
+        std::size_t row;
+        std::uint8_t step;
+        std::uint16_t pc; //address of the instruction the word belongs to
+    };
+    
+    template<trap_encoding encoding>
+    void print_lockstep_divergence(std::uint64_t cycle, const lockstep_expectation& expected, const lockstep_state& actual, µcode_type µop) noexcept
+    {
+        std::fprintf(stdout, "[Divergence] cycle %llu, instruction at %04X, ", static_cast<unsigned long long>(cycle), expected.pc);
+        print_row_name(expected.row, encoding);
+        std::fprintf(stdout, " step %u\n[Divergence] control word ", expected.step);
+        print_signals(µop);
+        std::fprintf(stdout, "\n");
+        
+#define LOCKSTEP_COMPARE(field) \
+        if (expected.state.field != actual.field) \
+        { \
+            std::fprintf(stdout, "[Divergence] %-7s simulator=%0*X model=%0*X\n", #field, \
+                         static_cast<int>(2 * sizeof(actual.field)), static_cast<unsigned int>(expected.state.field), \
+                         static_cast<int>(2 * sizeof(actual.field)), static_cast<unsigned int>(actual.field)); \
+        }
+        
+        LOCKSTEP_FIELDS(LOCKSTEP_COMPARE)
+#undef LOCKSTEP_COMPARE
+    }
+    
+    inline bool lockstep_equal(const lockstep_state& x, const lockstep_state& y) noexcept
+    {
+#define LOCKSTEP_EQUAL(field) && x.field == y.field
+        return true LOCKSTEP_FIELDS(LOCKSTEP_EQUAL);
+#undef LOCKSTEP_EQUAL
+    }
+    
+    struct lockstep_options
+    {
+        const char* model = nullptr; //a command that attaches to the ring named in MICROCODE_LOCKSTEP, the built-in model without one
+        std::uint64_t cycles = 0;
+    };
+    
+    template<trap_encoding encoding, typename layout>
+    int run_lockstep(const char* path, const lockstep_options& options) noexcept
+    {
+        auto sim = std::make_unique<simulator<encoding, layout>>(decoded_µcode<encoding, layout>);
+        
+        if (auto file = std::ifstream(path, std::ios::binary); file.good())
+        {
+            file.read(reinterpret_cast<char*>(sim->memory.data()), sim->memory.size());
+        }
+        
+        else
+        {
+            std::fprintf(stderr, "[Error] File %s could not be opened for reading\nExiting...\n", path);
+            return EXIT_FAILURE;
+        }
+        
+        const auto name = "/microcode-lockstep-" + std::to_string(::getpid());
+        const auto fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        const auto mapped = (fd >= 0 && ::ftruncate(fd, sizeof(lockstep_ring)) == 0) ? ::mmap(nullptr, sizeof(lockstep_ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        
+        if (mapped == MAP_FAILED)
+        {
+            ::shm_unlink(name.c_str());
+            std::fprintf(stderr, "[Error] Shared memory for the lockstep ring could not be created\nExiting...\n");
+            return EXIT_FAILURE;
+        }
+        
+        auto& shared = *new (mapped) lockstep_ring{};
+        
+        shared.magic = lockstep_magic;
+        shared.version = lockstep_version;
+        shared.batch_cycles = lockstep_batch_cycles;
+        shared.slots = lockstep_slots;
+        shared.memory = sim->memory;
+        
+        // the segment stays mapped in a forked model; an external one opens it by name
+        const auto model = ::fork();
+        
+        if (model == 0)
+        {
+            if (options.model)
+            {
+                ::setenv("MICROCODE_LOCKSTEP", name.c_str(), 1);
+                ::execl("/bin/sh", "sh", "-c", options.model, static_cast<char*>(nullptr));
+                ::_exit(127);
+            }
+            
+            lockstep_model<encoding, layout>(shared);
+            ::_exit(EXIT_SUCCESS);
+        }
+        
+        const auto finish = [&](int result)
+        {
+            shared.shutdown.store(1, std::memory_order_release);
+            
+            if (model > 0)
+            {
+                ::waitpid(model, nullptr, 0);
+            }
+            
+            ::munmap(mapped, sizeof(lockstep_ring));
+            ::shm_unlink(name.c_str());
+            
+            return result;
+        };
+        
+        if (model < 0)
+        {
+            std::fprintf(stderr, "[Error] Could not fork the lockstep model\nExiting...\n");
+            return finish(EXIT_FAILURE);
+        }
+        
+        auto expected = std::vector<std::array<lockstep_expectation, lockstep_batch_cycles>>(lockstep_slots);
+        auto submitted = std::uint64_t{ 0 }, checked = std::uint64_t{ 0 };
+        auto instruction = std::uint16_t{ 0 };
+        auto done = false;
+        
+        const auto budget = options.cycles ? options.cycles : std::numeric_limits<std::uint64_t>::max();
+        const auto start = std::chrono::steady_clock::now();
+        
+        while (!done || checked < submitted)
+        {
+            // run the next batch while the model still has a free slot
+            if (!done && submitted - checked < lockstep_slots)
+            {
+                auto& slot = shared.ring[submitted % lockstep_slots];
+                auto& expect = expected[submitted % lockstep_slots];
+                auto count = std::size_t{ 0 };
+                
+                while (count < lockstep_batch_cycles && !done)
+                {
+                    const auto µop = sim->word();
+                    const auto retired = sim->state.retired;
+                    
+                    // step 0 of a row is the fetch of the next instruction, it still counts towards the current one
+                    const auto next = (sim->state.step == 0) ? sim->state.pc : instruction;
+                    
+                    expect[count].row = sim->row();
+                    expect[count].step = sim->state.step;
+                    expect[count].pc = instruction;
+                    
+                    done = !sim->clock() || sim->state.cycles >= budget;
+                    instruction = next;
+                    
+                    slot.words[count] = { µop, static_cast<std::uint8_t>(sim->state.retired - retired), {} };
+                    expect[count].state = capture(*sim);
+                    
+                    ++count;
+                }
+                
+                slot.count = static_cast<std::uint32_t>(count);
+                shared.submitted.store(++submitted, std::memory_order_release);
+                continue;
+            }
+            
+            if (shared.completed.load(std::memory_order_acquire) > checked)
+            {
+                const auto& slot = shared.ring[checked % lockstep_slots];
+                const auto& expect = expected[checked % lockstep_slots];
+                
+                for (auto i = std::size_t{ 0 }; i < slot.count; ++i)
+                {
+                    if (!lockstep_equal(expect[i].state, slot.states[i]))
+                    {
+                        print_lockstep_divergence<encoding>(checked * lockstep_batch_cycles + i, expect[i], slot.states[i], slot.words[i].µop);
+                        return finish(EXIT_FAILURE);
+                    }
+                }
+                
+                ++checked;
+                continue;
+            }
+            
+            if (::waitpid(model, nullptr, WNOHANG) == model)
+            {
+                std::fprintf(stderr, "[Error] The lockstep model exited after %llu of %llu batches\nExiting...\n",
+                             static_cast<unsigned long long>(checked), static_cast<unsigned long long>(submitted));
+                ::munmap(mapped, sizeof(lockstep_ring));
+                ::shm_unlink(name.c_str());
+                return EXIT_FAILURE;
+            }
+            
+            std::this_thread::yield();
+        }
+        
+        const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        std::fprintf(stdout, "[Lockstep] %llu cycles, %llu instructions in %llu batches agree, %.2f s, %.2f M cycles/s%s\n",
+                     static_cast<unsigned long long>(sim->state.cycles), static_cast<unsigned long long>(sim->state.retired),
+                     static_cast<unsigned long long>(submitted), seconds, static_cast<double>(sim->state.cycles) / seconds / 1e6,
+                     sim->state.halted ? "" : ", stopped at the cycle limit");
+        
+        return finish(EXIT_SUCCESS);
+    }
+}
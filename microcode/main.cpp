@@ -2,529 +2,803 @@
 #include <cstdlib>
 #include <cstdio>
 
+#include <algorithm>
 #include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <vector>
 #include <array>
 #include <string>
 #include <string_view>
 #include <limits>
+#include <thread>
 
-#include "opcode.h"
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "microcode.h"
+#include "legacy_layout.h"
+#include "vertical_layout.h"
+#include "simulator.h"
+#include "snapshot.h"
+#include "fuzz.h"
+#include "alu_check.h"
+#include "wcet.h"
+#include "profile.h"
+#include "explore.h"
+#include "rom_image.h"
+#include "rom_diff.h"
+#include "locals_bench.h"
+#include "compiler_bench.h"
+#include "lockstep.h"
+#include "network.h"
 
 namespace
 {
-    consteval auto BIT(unsigned int s) noexcept
+    static constexpr const auto cycle_budget = std::uint64_t{ 1'000'000'000 };
+    
+    // a raw table for the EEPROM programmer, or with image an mmap-able file carrying a header and checksum
+    template<trap_encoding encoding, typename layout>
+    int write_rom(const char* path, bool image) noexcept
     {
-        return (std::uint64_t{ 1 } << s);
+        static constexpr auto& µcode = encoded_µcode<encoding, layout>;
+        
+        if constexpr (std::is_same_v<layout, vertical_layout>)
+        {
+            print_field_decoders();
+        }
+        
+        if (image)
+        {
+            if (write_rom_image<encoding, layout>(path))
+            {
+                return EXIT_SUCCESS;
+            }
+            
+            std::fprintf(stderr, "[Error] File %s could not be opened for writing\nExiting...\n", path);
+            return EXIT_FAILURE;
+        }
+        
+        if (auto file = std::ofstream(path, std::ios::binary); file.good())
+        {
+            for (const auto& µinsn : µcode)
+            {
+                for (const auto& µop : µinsn)
+                {
+                    file.write(reinterpret_cast<const char*>(&µop), sizeof(µop));
+                }
+            }
+            
+            return EXIT_SUCCESS;
+        }
+        
+        else
+        {
+            std::fprintf(stderr, "[Error] File %s could not be opened for writing\nExiting...\n", path);
+            return EXIT_FAILURE;
+        }
     }
     
-    consteval auto LEN(unsigned int s) noexcept
+    // the image is written from address 0, variables kept in memory sit at the spill area
+    template<trap_encoding encoding>
+    int compile_file(const char* source_path, const char* image_path) noexcept
     {
-        // TODO: this is a bit hacky
-        return (std::uint64_t{ s & 2 } << 62);
+        auto file = std::ifstream(source_path, std::ios::binary);
+        
+        if (!file.good())
+        {
+            std::fprintf(stderr, "[Error] File %s could not be opened for reading\nExiting...\n", source_path);
+            return EXIT_FAILURE;
+        }
+        
+        const auto source = std::string(std::istreambuf_iterator<char>(file), {});
+        auto error = compile_error{};
+        const auto program = compile<encoding>(source, error);
+        
+        if (!program)
+        {
+            std::fprintf(stderr, "[Error] %s:%u: %s\nExiting...\n", source_path, error.line, error.message.c_str());
+            return EXIT_FAILURE;
+        }
+        
+        for (auto v = std::size_t{ 0 }; v < program->variables.size(); ++v)
+        {
+            const auto& [first, last] = program->registers.live[v];
+            
+            if (const auto r = program->registers.home[v]) std::fprintf(stdout, "[Compile] %-12s %s, statements %zu-%zu\n", program->variables[v].c_str(), register_names[*r], first, last);
+            else std::fprintf(stdout, "[Compile] %-12s [%04X], statements %zu-%zu\n", program->variables[v].c_str(), program->registers.slot[v], first, last);
+        }
+        
+        std::fprintf(stdout, "[Compile] %zu bytes, %zu spills\n", program->image.size(), program->spills);
+        
+        if (auto out = std::ofstream(image_path, std::ios::binary); out.good())
+        {
+            out.write(reinterpret_cast<const char*>(program->image.data()), static_cast<std::streamsize>(program->image.size()));
+            return EXIT_SUCCESS;
+        }
+        
+        std::fprintf(stderr, "[Error] File %s could not be opened for writing\nExiting...\n", image_path);
+        return EXIT_FAILURE;
     }
     
-    static constexpr const auto µcode_line_width = 8;
-    
-    using µcode_type = std::uint64_t;
-    using µcode_line = std::array<µcode_type, µcode_line_width>;
-    
-    enum : µcode_type
-    {
-        // register file
-        RF_AI = BIT(0),
-        RF_BI = BIT(1),
-        RF_CI = BIT(2),
-        RF_DI = BIT(3),
-        RF_FI = BIT(4),
-        
-        RF_AO = BIT(5),
-        RF_BO = BIT(6),
-        RF_CO = BIT(7),
-        RF_DO = BIT(8),
-        RF_FO = BIT(9),
-        // /register file
-        
-        // load store unit
-        LSU_RE = BIT(10),
-        LSU_WE = BIT(11),
-        LSU_SP_D = BIT(12), //stack * direction, 1 = decrement
-        LSU_SP_WE = BIT(13),
-        LSU_SP_EN = BIT(14),
-        // /load store unit
-        
-        // arithmetic logic unit
-        ALU_ADD = BIT(15),
-        ALU_SUB = BIT(16),
-        ALU_AND = BIT(17),
-        ALU_OR = BIT(18),
-        ALU_NOT = BIT(19),
-        ALU_SHL = BIT(20),
-        ALU_SHR = BIT(21),
-        ALU_WA = BIT(22),
-        ALU_WB = BIT(23),
-        ALU_OE = BIT(24),
-        // /arithmetic logic unit
-        
-        // instruction register
-        IR_WE = BIT(25),
-        // /instruction register
-        
-        // program counter
-        PC_LRC = BIT(26),
-        PC_INI = BIT(27),
-        PC_CUB = BIT(28),
-        PC_OE = BIT(29),
-        // /program counter
-        
-        // address composition unit
-        ACU_WL = BIT(30),
-        ACU_WH = BIT(31),
-        ACU_OE = BIT(32),
-        // /address composition unit
-        
-        // address decomposition unit
-        ADU_RL = BIT(33),
-        ADU_RH = BIT(34),
-        ADU_WE = BIT(35),
-        // /address decomposition unit
-        
-        // misc
-        FORCE_JUMP = BIT(54),
-        REQUEST_JEZ = BIT(55),
-        REQUEST_JCS = BIT(56),
-        CONNECT_FB = BIT(57),
-        OUT_Q1 = BIT(58),
-        OUT_Q2 = BIT(59),
-        SET_HALT = BIT(60),
-        // /misc
-    };
-    
-    constexpr const auto FETCH_INSTRUCTION = PC_OE | LSU_RE | IR_WE,
-                                LSU_SP_INC = LSU_SP_EN | LSU_SP_WE,
-                                LSU_SP_DEC = LSU_SP_EN | LSU_SP_WE | LSU_SP_D,
-                            LSU_READ_STACK = LSU_SP_EN | LSU_RE,
-                           LSU_WRITE_STACK = LSU_SP_EN | LSU_WE;
-    
-    // TODO: determine how the instruction register will be written to after a reset to begin
-    
-    
-    //maybe--on reset
-    // PC_OE | PC_LRC | LSU_RE | IR_WE
-    
-    // Pseudocode:
-    // output pc
-    // input pc as load & reset -> step = 0 again (hopefully)
-    // read from rom
-    // write to ir
-    
-    consteval auto chk_trap(bool trap) noexcept
+    void print_state(const char* tag, const machine_state& state) noexcept
     {
-        return trap ? SET_HALT : 0;
+        std::fprintf(stdout, "[%s] pc=%04X sp=%04X a=%02X b=%02X c=%02X d=%02X f=%02X ir=%02X cycles=%llu retired=%llu\n",
+                     tag, state.pc, state.sp, state.a, state.b, state.c, state.d, state.f, state.ir,
+                     static_cast<unsigned long long>(state.cycles), static_cast<unsigned long long>(state.retired));
     }
     
-    consteval µcode_line emit_mvb(µcode_type dest_in, µcode_type src_out, bool trap, bool fmode) noexcept
+    struct run_options
+    {
+        std::vector<std::uint64_t> irq_periods{};
+        
+        bool restore = false; //the file is a snapshot rather than a memory image
+        const char* save = nullptr;
+        std::uint64_t save_at = 0;
+        
+        std::vector<const char*> scenarios{};
+        
+        bool profile = false;
+        
+        const char* table = nullptr; //a ROM image to execute instead of the built-in table
+        
+        // --rom <file>@<hex>, --uart/--timer/--gpio <hex>, mapped over the RAM image
+        std::string rom{};
+        std::uint16_t rom_base = 0;
+        std::vector<std::pair<device, std::uint16_t>> devices{};
+    };
+    
+    template<trap_encoding encoding, typename layout>
+    void print_interrupts(const simulator<encoding, layout>& sim, const layout_table<layout>& µcode) noexcept
     {
-        return
+        const auto& stats = sim.irq_stats;
+        
+        if (stats.taken == 0)
         {
-            LEN(1) | FETCH_INSTRUCTION,
-            LEN(1) | src_out | dest_in | (fmode ? CONNECT_FB : 0),
-            LEN(1) | PC_INI | chk_trap(trap),
-            
-            0ull, 0ull, 0ull, 0ull, 0ull,
-        };
+            std::fprintf(stdout, "[Interrupts] none taken\n");
+            return;
+        }
+        
+        // the step-0 fetch of the entry row already belongs to the handler
+        const auto entry = µcode_steps(µcode[ROW_IRQ]) - static_cast<unsigned int>(layout::fetch_steps), reti = µcode_steps(µcode[RETI]);
+        const auto poll = µcode_steps(µcode[LDB_A_MEM]) + µcode_steps(µcode[AND_A_IMM]) + µcode_steps(µcode[JEZ_MEM]);
+        
+        // a status poll inserted often enough to match the mean interrupt latency, once per interval of the program's own
+        // cycles; a poll cannot come round faster than it runs, so the interval is never shorter than the poll sequence
+        const auto mean = static_cast<double>(stats.latency_total) / static_cast<double>(stats.taken);
+        const auto interval = std::max(mean, static_cast<double>(poll));
+        const auto interrupted = static_cast<double>(stats.taken * (entry + reti));
+        const auto polled = (static_cast<double>(sim.state.cycles) - interrupted) * poll / interval;
+        
+        std::fprintf(stdout, "[Interrupts] taken=%llu latency min/mean/max=%llu/%.1f/%llu cycles, entry=%u cycles, reti=%u cycles\n",
+                     static_cast<unsigned long long>(stats.taken), static_cast<unsigned long long>(stats.latency_min),
+                     mean, static_cast<unsigned long long>(stats.latency_max), entry, reti);
+        std::fprintf(stdout, "[Interrupts] %u-cycle poll every %.1f cycles would cost %.0f cycles, interrupts cost %.0f, %.0f removed\n",
+                     poll, interval, polled, interrupted, polled - interrupted);
     }
     
-    consteval µcode_line emit_alu2reg(µcode_type dest_in, µcode_type dest_out, µcode_type src_out, µcode_type op, bool trap) noexcept
+    // resumes across single-step traps until BRK or the cycle limit
+    template<trap_encoding encoding, typename layout>
+    void run_until(simulator<encoding, layout>& sim, std::uint64_t limit) noexcept
     {
-        return
+        while (sim.state.cycles < limit && (sim.run(limit - sim.state.cycles), sim.state.halted && sim.state.ir != BRK))
         {
-            LEN(1) | FETCH_INSTRUCTION,
-            LEN(1) | dest_out | ALU_WA,
-            LEN(1) | src_out | ALU_WB,
-            LEN(1) | op | ALU_OE | dest_in | RF_FI,
-            LEN(1) | PC_INI | chk_trap(trap),
-            
-            0ull, 0ull, 0ull,
-        };
+            print_state("Trace", sim.state);
+            sim.resume();
+        }
     }
     
-    consteval µcode_line emit_aluimm(µcode_type dest_in, µcode_type dest_out, µcode_type op, bool trap) noexcept
+    template<trap_encoding encoding, typename layout>
+    int run_to_halt(simulator<encoding, layout>& sim, const run_options& options) noexcept
     {
-        return
+        const auto& µcode = sim.table();
+        
+        run_until(sim, cycle_budget);
+        
+        if (!sim.state.halted)
+        {
+            std::fprintf(stderr, "[Error] Program did not halt within %llu cycles\nExiting...\n", static_cast<unsigned long long>(cycle_budget));
+            return EXIT_FAILURE;
+        }
+        
+        print_state("Halt", sim.state);
+        
+        if constexpr (has_interrupts<layout>)
+        {
+            print_interrupts(sim, µcode);
+        }
+        
+        if (options.profile)
         {
-            LEN(2) | FETCH_INSTRUCTION,
-            LEN(2) | dest_out | ALU_WA,
-            LEN(2) | OUT_Q1 | ALU_WB,
-            LEN(2) | op | ALU_OE | dest_in | RF_FI,
-            LEN(2) | PC_INI | chk_trap(trap),
+            print_profile(sim, µcode);
+        }
+        
+        if (!options.rom.empty() || !options.devices.empty())
+        {
+            const auto& map = sim.map;
             
-            0ull, 0ull, 0ull,
-        };
+            std::fprintf(stdout, "\n[Devices] uart tx=%llu gpio=%02X (%llu writes) rom writes=%llu, %llu wait-state cycles\n",
+                         static_cast<unsigned long long>(map.uart.transmitted), map.gpio.output,
+                         static_cast<unsigned long long>(map.gpio.writes), static_cast<unsigned long long>(map.rom_writes),
+                         static_cast<unsigned long long>(map.stalls));
+        }
+        
+        return EXIT_SUCCESS;
     }
     
-    consteval µcode_line emit_alunot(µcode_type dest_in, µcode_type dest_out, bool trap) noexcept
+    // every scenario is a forked child that shares the checkpoint's pages copy-on-write;
+    // a scenario file is a little-endian load address followed by the bytes to place there
+    template<trap_encoding encoding, typename layout>
+    int run_scenarios(simulator<encoding, layout>& sim, const run_options& options) noexcept
     {
-        return
+        const auto& scenarios = options.scenarios;
+        const auto limit = std::max(1u, std::thread::hardware_concurrency());
+        
+        auto running = 0u, failed = 0u;
+        
+        const auto reap = [&]
         {
-            LEN(1) | FETCH_INSTRUCTION,
-            LEN(1) | dest_out | ALU_WA,
-            LEN(1) | ALU_NOT | ALU_OE | dest_in | RF_FI,
-            LEN(1) | PC_INI | chk_trap(trap),
+            auto status = 0;
             
-            0ull, 0ull, 0ull, 0ull,
+            if (::wait(&status) > 0)
+            {
+                --running;
+                failed += !(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+            }
         };
+        
+        for (auto i = std::size_t{ 0 }; i < scenarios.size(); ++i)
+        {
+            if (running == limit)
+            {
+                reap();
+            }
+            
+            std::fflush(stdout);
+            
+            if (const auto pid = ::fork(); pid == 0)
+            {
+                // buffer the child's whole report so scenarios running side by side do not interleave
+                std::setvbuf(stdout, nullptr, _IOFBF, 1 << 16);
+                std::fprintf(stdout, "[Scenario %zu] %s\n", i, scenarios[i]);
+                
+                auto file = std::ifstream(scenarios[i], std::ios::binary);
+                auto address = std::array<std::uint8_t, 2>{};
+                
+                if (!file.read(reinterpret_cast<char*>(address.data()), address.size()))
+                {
+                    std::fprintf(stderr, "[Error] Scenario %s could not be read\nExiting...\n", scenarios[i]);
+                    std::exit(EXIT_FAILURE);
+                }
+                
+                const auto base = static_cast<std::size_t>(address[0] | (address[1] << 8));
+                file.read(reinterpret_cast<char*>(sim.memory.data() + base), static_cast<std::streamsize>(sim.memory.size() - base));
+                
+                std::exit(run_to_halt(sim, options));
+            }
+            
+            else if (pid < 0)
+            {
+                std::fprintf(stderr, "[Error] Could not fork scenario %s\nExiting...\n", scenarios[i]);
+                return EXIT_FAILURE;
+            }
+            
+            ++running;
+        }
+        
+        while (running)
+        {
+            reap();
+        }
+        
+        std::fprintf(stdout, "[Scenarios] %zu run from cycle %llu, %u failed\n",
+                     scenarios.size(), static_cast<unsigned long long>(sim.state.cycles), failed);
+        
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
     }
     
-    consteval µcode_line emit_nop(bool trap) noexcept
+    template<trap_encoding encoding, typename layout>
+    int run_wcet(const char* path, const std::vector<std::uint16_t>& entries, const std::vector<loop_bound>& bounds) noexcept
     {
-        return
+        auto image = std::make_unique<std::array<std::uint8_t, 0x10000>>();
+        
+        if (auto file = std::ifstream(path, std::ios::binary); file.good())
         {
-            LEN(1) | FETCH_INSTRUCTION,
-            LEN(1) | PC_INI | chk_trap(trap),
-            
-            0ull, 0ull, 0ull, 0ull, 0ull, 0ull,
-        };
+            file.read(reinterpret_cast<char*>(image->data()), image->size());
+        }
+        
+        else
+        {
+            std::fprintf(stderr, "[Error] File %s could not be opened for reading\nExiting...\n", path);
+            return EXIT_FAILURE;
+        }
+        
+        auto analyser = wcet_analyser<encoding, layout>(*image, bounds);
+        
+        for (const auto entry : entries)
+        {
+            if (!analyser.function(entry))
+            {
+                return EXIT_FAILURE;
+            }
+        }
+        
+        for (const auto& [entry, cycles] : analyser.functions())
+        {
+            std::fprintf(stdout, "[WCET] function %04X: %llu cycles\n", entry, static_cast<unsigned long long>(cycles));
+        }
+        
+        return EXIT_SUCCESS;
     }
     
-    //doesn't accept trapping
-    consteval µcode_line emit_brk(void) noexcept
+    template<trap_encoding encoding, typename layout>
+    int run_image(const char* path, const run_options& options) noexcept
     {
-        return
+        auto rom = mapped_rom<encoding, layout>{};
+        
+        if (options.table && !rom.open(options.table))
         {
-            LEN(1) | FETCH_INSTRUCTION,
-            LEN(1) | PC_INI | SET_HALT,
+            std::fprintf(stderr, "[Error] File %s is not an intact microcode image for this encoding and layout\nExiting...\n", options.table);
+            return EXIT_FAILURE;
+        }
+        
+        if (options.table && !rom.built_in())
+        {
+            std::fprintf(stdout, "[Table] %s differs from the built-in table\n", options.table);
+        }
+        
+        auto sim = std::make_unique<simulator<encoding, layout>>(options.table ? rom.table() : decoded_µcode<encoding, layout>);
+        
+        if (options.profile)
+        {
+            sim->enable_profile();
+        }
+        
+        if (!options.restore)
+        {
+            auto file = std::ifstream(path, std::ios::binary);
             
-            0ull, 0ull, 0ull, 0ull, 0ull, 0ull,
-        };
+            if (!file.good())
+            {
+                std::fprintf(stderr, "[Error] File %s could not be opened for reading\nExiting...\n", path);
+                return EXIT_FAILURE;
+            }
+            
+            file.read(reinterpret_cast<char*>(sim->memory.data()), sim->memory.size());
+        }
+        
+        if (!options.rom.empty())
+        {
+            switch (sim->map.add_rom(options.rom.c_str(), options.rom_base))
+            {
+                case memory_map::rom_mapping::mapped:
+                    break;
+                
+                case memory_map::rom_mapping::unaligned:
+                    std::fprintf(stderr, "[Error] ROM image %s at %04X does not start on a 256-byte page\nExiting...\n", options.rom.c_str(), options.rom_base);
+                    return EXIT_FAILURE;
+                
+                case memory_map::rom_mapping::too_large:
+                    std::fprintf(stderr, "[Error] ROM image %s does not fit in the %u bytes from %04X to the end of memory\nExiting...\n",
+                                 options.rom.c_str(), 0x10000u - options.rom_base, options.rom_base);
+                    return EXIT_FAILURE;
+                
+                default:
+                    std::fprintf(stderr, "[Error] ROM image %s could not be mapped\nExiting...\n", options.rom.c_str());
+                    return EXIT_FAILURE;
+            }
+        }
+        
+        for (const auto& [kind, base] : options.devices)
+        {
+            sim->map.add_device(kind, base);
+        }
+        
+        // after the map is built, a snapshot only restores onto the devices it was taken with
+        if (options.restore && !load_snapshot(*sim, path))
+        {
+            std::fprintf(stderr, "[Error] File %s is not a snapshot for this encoding, layout and device map\nExiting...\n", path);
+            return EXIT_FAILURE;
+        }
+        
+        for (const auto period : options.irq_periods)
+        {
+            sim->add_source(period);
+        }
+        
+        if (!options.restore)
+        {
+            do
+            {
+                sim->clock();
+            }
+            while (sim->state.step != layout::fetch_steps);
+            
+            std::fprintf(stdout, "[Reset] first instruction fetched after %llu cycles\n", static_cast<unsigned long long>(sim->state.cycles));
+        }
+        
+        if (options.save)
+        {
+            run_until(*sim, options.save_at);
+            
+            if (!save_snapshot(*sim, options.save))
+            {
+                std::fprintf(stderr, "[Error] File %s could not be opened for writing\nExiting...\n", options.save);
+                return EXIT_FAILURE;
+            }
+            
+            print_state("Snapshot", sim->state);
+            return EXIT_SUCCESS;
+        }
+        
+        if (!options.scenarios.empty())
+        {
+            return run_scenarios(*sim, options);
+        }
+        
+        return run_to_halt(*sim, options);
     }
+}
+
+
+
+int main(int argc, const char** argv)
+{
+    auto args = std::vector<std::string_view>(argv + 1, argv + argc);
+    
+    const auto option = [&](std::string_view name)
+    {
+        const auto it = std::find(args.begin(), args.end(), name);
+        return (it != args.end()) ? (args.erase(it), true) : false;
+    };
     
-    consteval µcode_line emit_ldbimm(µcode_type dest_in, bool trap) noexcept
+    const auto value = [&](std::string_view name) -> std::optional<std::string_view>
     {
-        return
+        const auto it = std::find(args.begin(), args.end(), name);
+        
+        if (it == args.end() || std::next(it) == args.end())
         {
-            LEN(2) | FETCH_INSTRUCTION,
-            LEN(2) | OUT_Q1 | dest_in,
-            LEN(2) | PC_INI | chk_trap(trap),
-            
-            0ull, 0ull, 0ull, 0ull, 0ull,
-        };
+            return std::nullopt;
+        }
+        
+        const auto result = *std::next(it);
+        args.erase(it, std::next(it, 2));
+        return result;
+    };
+    
+    const auto image = option("--image"), disasm = option("--disasm");
+    const auto run = option("--run"), step_mode = option("--step-mode"), legacy = option("--legacy"), vertical = option("--vertical"), fuzz = option("--fuzz"), check_alu = option("--check-alu"), wcet = option("--wcet"), explore = option("--explore"), bench_locals = option("--bench-locals");
+    const auto compile_source = option("--compile"), bench_compiler = option("--bench-compiler"), lockstep = option("--lockstep"), simulate_network = option("--network");
+    
+    auto options = run_options{};
+    
+    while (const auto period = value("--irq"))
+    {
+        options.irq_periods.push_back(std::strtoull(period->data(), nullptr, 0));
     }
     
-    consteval µcode_line emit_ldbmem(µcode_type dest_in, bool trap) noexcept
+    options.restore = option("--restore");
+    options.profile = option("--profile");
+    
+    if (const auto table = value("--table"))
     {
-        return
-        {
-            LEN(3) | FETCH_INSTRUCTION,
-            LEN(3) | OUT_Q1 | ACU_WL,
-            LEN(3) | OUT_Q2 | ACU_WH,
-            LEN(3) | ACU_OE | LSU_RE | dest_in,
-            LEN(3) | PC_INI | chk_trap(trap),
-            
-            0ull, 0ull, 0ull,
-        };
+        options.table = table->data();
     }
     
-    consteval µcode_line emit_stbmem(µcode_type src_out, bool trap) noexcept
+    if (const auto save = value("--save"))
     {
-        return
-        {
-            LEN(3) | FETCH_INSTRUCTION,
-            LEN(3) | OUT_Q1 | ACU_WL,
-            LEN(3) | OUT_Q2 | ACU_WH,
-            LEN(3) | ACU_OE | LSU_WE | src_out,
-            LEN(3) | PC_INI | chk_trap(trap),
-            
-            0ull, 0ull, 0ull,
-        };
+        options.save = save->data();
+        
+        const auto at = value("--at");
+        options.save_at = at ? std::strtoull(at->data(), nullptr, 0) : cycle_budget;
     }
     
-    consteval µcode_line emit_pop8r(µcode_type dest_in, bool trap) noexcept
+    while (const auto scenario = value("--scenario"))
     {
-        return
-        {
-            LEN(1) | FETCH_INSTRUCTION,
-            LEN(1) | LSU_READ_STACK | dest_in,
-            LEN(1) | LSU_SP_INC,
-            LEN(1) | PC_INI | chk_trap(trap),
-            
-            0ull, 0ull, 0ull, 0ull,
-        };
+        options.scenarios.push_back(scenario->data());
     }
     
-    consteval µcode_line emit_push8r(µcode_type src_out, bool trap) noexcept
+    if (const auto rom = value("--rom"))
     {
-        return
+        const auto at = rom->rfind('@');
+        
+        if (at == std::string_view::npos)
         {
-            LEN(1) | FETCH_INSTRUCTION,
-            LEN(1) | LSU_SP_DEC,
-            LEN(1) | LSU_WRITE_STACK | src_out,
-            LEN(1) | PC_INI | chk_trap(trap),
-            
-            0ull, 0ull, 0ull, 0ull,
-        };
+            std::fprintf(stderr, "[Error] --rom expects <file>@<hex address>\nExiting...\n");
+            return EXIT_FAILURE;
+        }
+        
+        options.rom = rom->substr(0, at);
+        options.rom_base = static_cast<std::uint16_t>(std::strtoul(rom->data() + at + 1, nullptr, 16));
+        
+        if (options.rom_base & 0xFF)
+        {
+            std::fprintf(stderr, "[Error] --rom address %04X does not start on a 256-byte page\nExiting...\n", options.rom_base);
+            return EXIT_FAILURE;
+        }
     }
     
-
-    consteval µcode_line emit_popip(bool trap) noexcept
+    for (const auto& [name, kind] : { std::pair{ "--uart", device::uart }, std::pair{ "--timer", device::timer }, std::pair{ "--gpio", device::gpio } })
     {
-        return
+        if (const auto base = value(name))
         {
-            LEN(1) | FETCH_INSTRUCTION,
-            LEN(1) | LSU_READ_STACK | ACU_WL,
-            LEN(1) | LSU_SP_INC,
-            LEN(1) | LSU_READ_STACK | ACU_WH,
-            LEN(1) | LSU_SP_INC,
-            LEN(1) | ACU_OE | PC_LRC | FORCE_JUMP,
-            LEN(1) | PC_INI | chk_trap(trap),
-            
-            0ull,
-        };
+            options.devices.push_back({ kind, static_cast<std::uint16_t>(std::strtoul(base->data(), nullptr, 16)) });
+        }
     }
     
-    consteval µcode_line emit_puship(bool trap) noexcept
+    if (!options.irq_periods.empty() && legacy)
     {
-        return
-        {
-            LEN(1) | FETCH_INSTRUCTION,
-            LEN(1) | PC_OE | ADU_WE,
-            LEN(1) | LSU_SP_DEC,
-            LEN(1) | LSU_WRITE_STACK | ADU_RH,
-            LEN(1) | LSU_SP_DEC,
-            LEN(1) | LSU_WRITE_STACK | ADU_RL,
-            LEN(1) | PC_INI | chk_trap(trap),
-            
-            0ull,
-        };
+        std::fprintf(stderr, "[Error] The legacy board has no interrupt hardware\nExiting...\n");
+        return EXIT_FAILURE;
     }
     
-    consteval µcode_line emit_jump(µcode_type condition, bool trap) noexcept
+    if (legacy && step_mode)
     {
-        return
-        {
-            LEN(1) | FETCH_INSTRUCTION,
-            LEN(1) | OUT_Q1 | ACU_WL,
-            LEN(1) | OUT_Q2 | ACU_WH,
-            LEN(1) | ACU_OE | PC_LRC | condition | chk_trap(trap),
-            
-            0ull, 0ull, 0ull, 0ull,
-        };
+        std::fprintf(stderr, "[Error] The legacy board has no single-step mode hardware\nExiting...\n");
+        return EXIT_FAILURE;
     }
     
-    consteval µcode_line emit_deref(µcode_type src1_out, µcode_type src2_out, µcode_type dest_in, bool trap)
+    if (legacy && vertical)
     {
-        return
-        {
-            LEN(1) | FETCH_INSTRUCTION,
-            LEN(1) | src1_out | ACU_WL,
-            LEN(1) | src2_out | ACU_WH,
-            LEN(1) | ACU_OE | LSU_RE | dest_in,
-            LEN(1) | PC_INI | chk_trap(trap),
-            
-            0ull, 0ull, 0ull,
-        };
+        std::fprintf(stderr, "[Error] Only this board's control word has a vertical encoding\nExiting...\n");
+        return EXIT_FAILURE;
     }
     
+    if (disasm)
+    {
+        const auto layout = legacy ? legacy_layout::id : vertical ? vertical_layout::id : current_layout::id;
+        const auto encoding = step_mode ? trap_encoding::mode_flag : trap_encoding::opcode_bit;
+        
+        if (args.size() == 1) return run_disasm(args[0].data(), layout, encoding);
+        if (args.size() == 2) return run_rom_diff(args[0].data(), args[1].data(), layout, encoding);
+        
+        std::fprintf(stderr, "[Error] --disasm takes one table to list or two to compare\nExiting...\n");
+        return EXIT_FAILURE;
+    }
     
-    constexpr auto write_µcode(void) noexcept
+    if (bench_locals)
     {
-        constexpr auto NTRAP = 0x00, TRAP = 0x80;
+        const auto depth = value("--depth");
+        const auto n = depth ? std::strtoul(depth->data(), nullptr, 0) : 20ul;
         
-        std::array<µcode_line, std::numeric_limits<std::uint8_t>::max() + 1> µcode{};
+        if (n > 0xFF)
+        {
+            std::fprintf(stderr, "[Error] --depth takes an 8-bit argument\nExiting...\n");
+            return EXIT_FAILURE;
+        }
         
-        // misc
+        if (legacy)
         {
-            µcode[NOP | NTRAP] = emit_nop(false);
-            µcode[NOP |  TRAP] = emit_nop(true);
-            
-            µcode[BRK | NTRAP] = emit_brk();
+            std::fprintf(stderr, "[Error] The legacy board has no stack-relative addressing\nExiting...\n");
+            return EXIT_FAILURE;
         }
         
-#define CREATE_MVB_X_Y(x, y, z) µcode[MVB_##x##_##y | NTRAP] = emit_mvb(RF_##x##I, RF_##y##O, false, z); \
-                                µcode[MVB_##x##_##y |  TRAP] = emit_mvb(RF_##x##I, RF_##y##O, true,  z);
-        // r0 -> other register moving
+        // the stack-relative opcodes sit where opcode_bit keeps its trapping duplicates
+        if (!step_mode)
         {
-            CREATE_MVB_X_Y(A, B, false)
-            CREATE_MVB_X_Y(A, C, false)
-            CREATE_MVB_X_Y(A, D, false)
-            CREATE_MVB_X_Y(A, F, true)
+            std::fprintf(stderr, "[Error] Stack-relative addressing needs the --step-mode encoding\nExiting...\n");
+            return EXIT_FAILURE;
         }
         
-        // r1 -> other register moving
+        return vertical ? run_locals_bench<vertical_layout>(static_cast<std::uint8_t>(n), cycle_budget) :
+                          run_locals_bench<current_layout>(static_cast<std::uint8_t>(n), cycle_budget);
+    }
+    
+    if (compile_source)
+    {
+        if (args.size() != 2)
         {
-            CREATE_MVB_X_Y(B, A, false)
-            CREATE_MVB_X_Y(B, C, false)
-            CREATE_MVB_X_Y(B, D, false)
-            CREATE_MVB_X_Y(B, F, true)
+            std::fprintf(stderr, "[Error] --compile takes a source file and an image to write\nExiting...\n");
+            return EXIT_FAILURE;
         }
         
-        // r2 -> other register moving
+        return step_mode ? compile_file<trap_encoding::mode_flag>(args[0].data(), args[1].data()) : compile_file<trap_encoding::opcode_bit>(args[0].data(), args[1].data());
+    }
+    
+    if (bench_compiler)
+    {
+        if (legacy) return run_compiler_bench<trap_encoding::opcode_bit, legacy_layout>(cycle_budget);
+        if (vertical) return step_mode ? run_compiler_bench<trap_encoding::mode_flag, vertical_layout>(cycle_budget) : run_compiler_bench<trap_encoding::opcode_bit, vertical_layout>(cycle_budget);
+        
+        return step_mode ? run_compiler_bench<trap_encoding::mode_flag, current_layout>(cycle_budget) : run_compiler_bench<trap_encoding::opcode_bit, current_layout>(cycle_budget);
+    }
+    
+    if (lockstep)
+    {
+        auto comparison = lockstep_options{};
+        
+        if (const auto model = value("--model")) comparison.model = model->data();
+        if (const auto cycles = value("--cycles")) comparison.cycles = std::strtoull(cycles->data(), nullptr, 0);
+        
+        if (args.size() != 1)
         {
-            CREATE_MVB_X_Y(C, A, false)
-            CREATE_MVB_X_Y(C, B, false)
-            CREATE_MVB_X_Y(C, D, false)
-            CREATE_MVB_X_Y(C, F, true)
+            std::fprintf(stderr, "[Error] --lockstep takes one program image\nExiting...\n");
+            return EXIT_FAILURE;
         }
         
-        // r3 -> other register moving
+        const auto path = args.front().data();
+        
+        if (legacy) return run_lockstep<trap_encoding::opcode_bit, legacy_layout>(path, comparison);
+        if (vertical) return step_mode ? run_lockstep<trap_encoding::mode_flag, vertical_layout>(path, comparison) : run_lockstep<trap_encoding::opcode_bit, vertical_layout>(path, comparison);
+        
+        return step_mode ? run_lockstep<trap_encoding::mode_flag, current_layout>(path, comparison) : run_lockstep<trap_encoding::opcode_bit, current_layout>(path, comparison);
+    }
+    
+    if (simulate_network)
+    {
+        auto networking = network_options{};
+        
+        if (const auto boards = value("--boards")) networking.boards = std::strtoull(boards->data(), nullptr, 0);
+        if (const auto threads = value("--threads")) networking.threads = static_cast<unsigned int>(std::strtoul(threads->data(), nullptr, 0));
+        if (const auto cycles = value("--cycles")) networking.cycles = std::strtoull(cycles->data(), nullptr, 0);
+        if (const auto quantum = value("--quantum")) networking.quantum = std::strtoull(quantum->data(), nullptr, 0);
+        if (const auto latency = value("--latency")) networking.latency = std::strtoull(latency->data(), nullptr, 0);
+        if (const auto jitter = value("--jitter")) networking.jitter = std::strtoull(jitter->data(), nullptr, 0);
+        if (const auto seed = value("--seed")) networking.seed = std::strtoull(seed->data(), nullptr, 0);
+        
+        networking.wiring = option("--pairs") ? topology::pairs : topology::ring;
+        networking.private_tables = option("--private-tables");
+        
+        for (const auto& [kind, base] : options.devices)
+        {
+            if (kind == device::uart) networking.uart = base;
+        }
+        
+        if (args.size() != 1)
         {
-            CREATE_MVB_X_Y(D, A, false)
-            CREATE_MVB_X_Y(D, B, false)
-            CREATE_MVB_X_Y(D, C, false)
-            CREATE_MVB_X_Y(D, F, true)
+            std::fprintf(stderr, "[Error] --network takes one program image for every board\nExiting...\n");
+            return EXIT_FAILURE;
         }
-#undef CREATE_MVB_X_Y
         
+        const auto path = args.front().data();
+        
+        if (legacy) return run_network<trap_encoding::opcode_bit, legacy_layout>(path, networking);
+        if (vertical) return step_mode ? run_network<trap_encoding::mode_flag, vertical_layout>(path, networking) : run_network<trap_encoding::opcode_bit, vertical_layout>(path, networking);
+        
+        return step_mode ? run_network<trap_encoding::mode_flag, current_layout>(path, networking) : run_network<trap_encoding::opcode_bit, current_layout>(path, networking);
+    }
+    
+    if (explore)
+    {
+        const auto threads = value("--threads");
+        auto suite = std::vector<benchmark>{};
         
-#define CREATE_ALUR_X_Y(x, y, o, w) µcode[w##_##x##_##y | NTRAP] = emit_alu2reg(RF_##x##I, RF_##x##O, RF_##y##O, o, false); \
-                                    µcode[w##_##x##_##y |  TRAP] = emit_alu2reg(RF_##x##I, RF_##x##O, RF_##y##O, o, true);
-#define ENUM_ALUR(x, y) CREATE_ALUR_X_Y(x, y, ALU_ADD, ADC) \
-                        CREATE_ALUR_X_Y(x, y, ALU_SUB, SBB) \
-                        CREATE_ALUR_X_Y(x, y, ALU_AND, AND) \
-                        CREATE_ALUR_X_Y(x, y, ALU_OR,  LOR)
+        for (const auto arg : args)
         {
-            ENUM_ALUR(A, B)
-            ENUM_ALUR(A, C)
-            ENUM_ALUR(A, D)
-            
-            ENUM_ALUR(B, A)
-            ENUM_ALUR(B, C)
-            ENUM_ALUR(B, D)
+            auto file = std::ifstream(arg.data(), std::ios::binary);
             
-            ENUM_ALUR(C, A)
-            ENUM_ALUR(C, B)
-            ENUM_ALUR(C, D)
+            if (!file.good())
+            {
+                std::fprintf(stderr, "[Error] File %s could not be opened for reading\nExiting...\n", arg.data());
+                return EXIT_FAILURE;
+            }
             
-            ENUM_ALUR(D, A)
-            ENUM_ALUR(D, B)
-            ENUM_ALUR(D, C)
+            suite.push_back({ arg.data(), std::vector<std::uint8_t>(std::istreambuf_iterator<char>(file), {}) });
+            suite.back().image.resize(std::min<std::size_t>(suite.back().image.size(), 0x10000));
         }
-#undef ENUM_ALUR
-#undef CREATE_ALUR_X_Y
-
-        //µcode_type dest_in, µcode_type dest_out, µcode_type op, bool trap
-#define CREATE_ALUI_X(x, o, w) µcode[w##_##x##_IMM | NTRAP] = emit_aluimm(RF_##x##I, RF_##x##O, o, false); \
-                               µcode[w##_##x##_IMM |  TRAP] = emit_aluimm(RF_##x##I, RF_##x##O, o, false);
-#define ENUM_ALUI(x) CREATE_ALUI_X(x, ALU_ADD, ADC) \
-                     CREATE_ALUI_X(x, ALU_SUB, SBB) \
-                     CREATE_ALUI_X(x, ALU_AND, AND) \
-                     CREATE_ALUI_X(x, ALU_OR,  LOR) \
-                     CREATE_ALUI_X(x, ALU_SHL, ROL) \
-                     CREATE_ALUI_X(x, ALU_SHR, ROR)
-        {
-            ENUM_ALUI(A)
-            ENUM_ALUI(B)
-            ENUM_ALUI(C)
-            ENUM_ALUI(D)
-        }
-#undef ENUM_ALUI
-#undef CREATE_ALUI
-
         
-#define CREATE_ALU_NOT(x) µcode[NOT_##x | NTRAP] = emit_alunot(RF_##x##I, RF_##x##O, false); \
-                          µcode[NOT_##x |  TRAP] = emit_alunot(RF_##x##I, RF_##x##O, true);
+        if (suite.empty())
         {
-            CREATE_ALU_NOT(A)
-            CREATE_ALU_NOT(B)
-            CREATE_ALU_NOT(C)
-            CREATE_ALU_NOT(D)
+            std::fprintf(stderr, "[Error] --explore needs at least one benchmark image\nExiting...\n");
+            return EXIT_FAILURE;
         }
         
-
-#define CREATE_LDB(x) µcode[LDB_##x##_IMM | NTRAP] = emit_ldbimm(RF_##x##I, false); \
-                      µcode[LDB_##x##_IMM |  TRAP] = emit_ldbimm(RF_##x##I, true); \
-                      µcode[LDB_##x##_MEM | NTRAP] = emit_ldbmem(RF_##x##I, false); \
-                      µcode[LDB_##x##_MEM |  TRAP] = emit_ldbmem(RF_##x##I, true);
+        return run_explore(suite, threads ? static_cast<unsigned int>(std::strtoul(threads->data(), nullptr, 0)) : 0u, cycle_budget);
+    }
+    
+    if (wcet)
+    {
+        auto entries = std::vector<std::uint16_t>{};
+        auto bounds = std::vector<loop_bound>{};
+        
+        while (const auto entry = value("--entry"))
         {
-            CREATE_LDB(A)
-            CREATE_LDB(B)
-            CREATE_LDB(C)
-            CREATE_LDB(D)
+            entries.push_back(static_cast<std::uint16_t>(std::strtoul(entry->data(), nullptr, 16)));
         }
-#undef CREATE_LDB
-       
-        //µcode_type src_out, bool trap
-#define CREATE_STB(x) µcode[STB_MEM_##x | NTRAP] = emit_stbmem(RF_##x##O, false); \
-                      µcode[STB_MEM_##x |  TRAP] = emit_stbmem(RF_##x##O, true);
+        
+        // --bound <header>:<iterations>, the header address in hex
+        while (const auto bound = value("--bound"))
         {
-            CREATE_STB(A)
-            CREATE_STB(B)
-            CREATE_STB(C)
-            CREATE_STB(D)
+            auto end = static_cast<char*>(nullptr);
+            const auto header = static_cast<std::uint16_t>(std::strtoul(bound->data(), &end, 16));
+            
+            if (*end != ':')
+            {
+                std::fprintf(stderr, "[Error] Loop bound %s is not <header>:<iterations>\nExiting...\n", bound->data());
+                return EXIT_FAILURE;
+            }
+            
+            bounds.push_back({ header, std::strtoull(end + 1, nullptr, 0) });
         }
-#undef CREATE_STB
-        
-        
-        µcode[PUSH_IP | NTRAP] = emit_puship(false);
-        µcode[PUSH_IP |  TRAP] = emit_puship(true);
         
-        µcode[POP_IP | NTRAP] = emit_popip(false);
-        µcode[POP_IP |  TRAP] = emit_popip(true);
+        if (entries.empty())
+        {
+            entries.push_back(0);
+        }
         
-#define CREATE_STACKR(x) µcode[PUSH_##x | NTRAP] = emit_push8r(RF_##x##O, false); \
-                         µcode[PUSH_##x |  TRAP] = emit_push8r(RF_##x##O, true); \
-                         µcode[POP_##x | NTRAP] = emit_pop8r(RF_##x##O, false); \
-                         µcode[POP_##x |  TRAP] = emit_pop8r(RF_##x##O, true);
+        if (args.size() != 1)
         {
-            CREATE_STACKR(A)
-            CREATE_STACKR(B)
-            CREATE_STACKR(C)
-            CREATE_STACKR(D)
+            std::fprintf(stderr, "[Error] --wcet takes one program image\nExiting...\n");
+            return EXIT_FAILURE;
         }
-#undef CREATE_STACKR
         
-        µcode[JEZ_MEM | NTRAP] = emit_jump(REQUEST_JEZ, false);
-        µcode[JEZ_MEM |  TRAP] = emit_jump(REQUEST_JEZ, true);
+        const auto path = args.front().data();
         
-        µcode[JCS_MEM | NTRAP] = emit_jump(REQUEST_JCS, false);
-        µcode[JCS_MEM |  TRAP] = emit_jump(REQUEST_JCS, true);
+        if (legacy) return run_wcet<trap_encoding::opcode_bit, legacy_layout>(path, entries, bounds);
         
-        µcode[JMP_MEM | NTRAP] = emit_jump(FORCE_JUMP, false);
-        µcode[JMP_MEM |  TRAP] = emit_jump(FORCE_JUMP, true);
+        return step_mode ? run_wcet<trap_encoding::mode_flag, current_layout>(path, entries, bounds) : run_wcet<trap_encoding::opcode_bit, current_layout>(path, entries, bounds);
+    }
+    
+    if (check_alu)
+    {
+        const auto threads = value("--threads");
+        const auto count = threads ? static_cast<unsigned int>(std::strtoul(threads->data(), nullptr, 0)) : 0u;
         
+        if (legacy) return run_alu_check<trap_encoding::opcode_bit, legacy_layout>(count);
+        if (vertical) return step_mode ? run_alu_check<trap_encoding::mode_flag, vertical_layout>(count) : run_alu_check<trap_encoding::opcode_bit, vertical_layout>(count);
         
-        µcode[DEREF_AB_A | NTRAP] = emit_deref(RF_AO, RF_BO, RF_AI, false);
-        µcode[DEREF_AB_A |  TRAP] = emit_deref(RF_AO, RF_BO, RF_BI, true);
+        return step_mode ? run_alu_check<trap_encoding::mode_flag, current_layout>(count) : run_alu_check<trap_encoding::opcode_bit, current_layout>(count);
+    }
+    
+    if (fuzz)
+    {
+        auto fuzzing = fuzz_options{};
         
-        µcode[DEREF_CD_C | NTRAP] = emit_deref(RF_CO, RF_DO, RF_CI, false);
-        µcode[DEREF_CD_C |  TRAP] = emit_deref(RF_CO, RF_DO, RF_CI, true);
+        if (const auto seed = value("--seed")) fuzzing.seed = std::strtoull(seed->data(), nullptr, 0);
+        if (const auto programs = value("--programs")) fuzzing.programs = std::strtoull(programs->data(), nullptr, 0);
+        if (const auto threads = value("--threads")) fuzzing.threads = static_cast<unsigned int>(std::strtoul(threads->data(), nullptr, 0));
         
-        return µcode;
+        if (!args.empty())
+        {
+            std::fprintf(stderr, "[Error] --fuzz takes no file\nExiting...\n");
+            return EXIT_FAILURE;
+        }
+        
+        if (legacy) return run_fuzz<trap_encoding::opcode_bit, legacy_layout>(fuzzing);
+        if (vertical) return step_mode ? run_fuzz<trap_encoding::mode_flag, vertical_layout>(fuzzing) : run_fuzz<trap_encoding::opcode_bit, vertical_layout>(fuzzing);
+        
+        return step_mode ? run_fuzz<trap_encoding::mode_flag, current_layout>(fuzzing) : run_fuzz<trap_encoding::opcode_bit, current_layout>(fuzzing);
     }
-}
-
-
-
-
-int main(int argc, const char** argv)
-{
-    if (argc == 2)
+    
+    if (args.size() == 1)
     {
-        constexpr auto µcode = write_µcode();
+        const auto path = args.front().data();
         
-        if (auto file = std::ofstream(argv[1]); file.good())
+        if (run)
         {
-            for (const auto& µinsn : µcode)
-            {
-                for (const auto& µop : µinsn)
-                {
-                    file.write(reinterpret_cast<char*>(µop), sizeof(µop));
-                }
-            }
+            if (legacy) return run_image<trap_encoding::opcode_bit, legacy_layout>(path, options);
+            if (vertical) return step_mode ? run_image<trap_encoding::mode_flag, vertical_layout>(path, options) : run_image<trap_encoding::opcode_bit, vertical_layout>(path, options);
             
-            return EXIT_SUCCESS;
+            return step_mode ? run_image<trap_encoding::mode_flag, current_layout>(path, options) : run_image<trap_encoding::opcode_bit, current_layout>(path, options);
         }
         
         else
         {
-            std::fprintf(stderr, "[Error] File %s could not be opened for writing\nExiting...\n", argv[1]);
-            return EXIT_FAILURE;
+            if (legacy) return write_rom<trap_encoding::opcode_bit, legacy_layout>(path, image);
+            if (vertical) return step_mode ? write_rom<trap_encoding::mode_flag, vertical_layout>(path, image) : write_rom<trap_encoding::opcode_bit, vertical_layout>(path, image);
+            
+            return step_mode ? write_rom<trap_encoding::mode_flag, current_layout>(path, image) : write_rom<trap_encoding::opcode_bit, current_layout>(path, image);
         }
     }
     
     else
     {
-        std::fprintf(stderr, "[Error] %i arguments were passed, but 1 was expected\nExiting...\n", (argc - 1));
+        std::fprintf(stderr, "[Error] %zu arguments were passed, but 1 was expected\n"
+                             "Usage: microcode [--image] [--step-mode] [--legacy | --vertical] <file>\n"
+                             "       microcode --run [--step-mode] [--legacy | --vertical] [--table <image>] [--irq <period>]... <file>\n"
+                             "       microcode --run [--profile] [--rom <file>@<hex>] [--uart|--timer|--gpio <hex>]... [--restore] [--save <snapshot> [--at <cycle>] | --scenario <file>...] ... <file>\n"
+                             "       microcode --fuzz [--step-mode] [--legacy | --vertical] [--seed <n>] [--programs <n>] [--threads <n>]\n"
+                             "       microcode --check-alu [--step-mode] [--legacy | --vertical] [--threads <n>]\n"
+                             "       microcode --wcet [--step-mode | --legacy] [--entry <hex>]... [--bound <hex>:<n>]... <file>\n"
+                             "       microcode --explore [--threads <n>] <file>...\n"
+                             "       microcode --bench-locals --step-mode [--vertical] [--depth <n>]\n"
+                             "       microcode --compile [--step-mode] <source> <image>\n"
+                             "       microcode --bench-compiler [--step-mode] [--legacy | --vertical]\n"
+                             "       microcode --lockstep [--step-mode] [--legacy | --vertical] [--model <command>] [--cycles <n>] <file>\n"
+                             "       microcode --network [--step-mode] [--legacy | --vertical] [--boards <n>] [--threads <n>] [--cycles <n>] [--quantum <n>]\n"
+                             "                           [--latency <n>] [--jitter <n>] [--seed <n>] [--uart <hex>] [--pairs] [--private-tables] <file>\n"
+                             "       microcode --disasm [--step-mode] [--legacy | --vertical] <table> [<table>]\nExiting...\n", args.size());
         return EXIT_FAILURE;
     }
 }
-
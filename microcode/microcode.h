@@ -0,0 +1,934 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <array>
+#include <limits>
+
+#include "opcode.h"
+
+namespace
+{
+    consteval auto BIT(unsigned int s) noexcept
+    {
+        return (std::uint64_t{ 1 } << s);
+    }
+    
+    consteval auto LEN(unsigned int s) noexcept
+    {
+        // instruction length in bytes, consumed by PC_INI and an untaken PC_LRC
+        return (std::uint64_t{ s & 3 } << 62);
+    }
+    
+    static constexpr const auto µcode_line_width = 8;
+    
+    using µcode_type = std::uint64_t;
+    using µcode_line = std::array<µcode_type, µcode_line_width>;
+    using µcode_table = std::array<µcode_line, std::numeric_limits<std::uint8_t>::max() + 1>;
+    
+    // the word a layout stores per step, whatever its translate() produces
+    template<typename layout>
+    using layout_word = typename decltype(layout::translate(µcode_line{}))::value_type;
+    
+    // the table a layout's sequencer indexes, which may have wider lines, more rows or narrower words than the emitters' own
+    template<typename layout>
+    using layout_table = std::array<std::array<layout_word<layout>, layout::width>, layout::rows>;
+    
+    // the signals a stored word drives, through the field decoders on layouts with encoded words
+    template<typename layout>
+    constexpr µcode_type expand_word(layout_word<layout> word) noexcept
+    {
+        if constexpr (requires { layout::expand(word); })
+        {
+            return layout::expand(word);
+        }
+        
+        else
+        {
+            return word;
+        }
+    }
+    
+    enum : µcode_type
+    {
+        // register file
+        RF_AI = BIT(0),
+        RF_BI = BIT(1),
+        RF_CI = BIT(2),
+        RF_DI = BIT(3),
+        RF_FI = BIT(4),
+        
+        RF_AO = BIT(5),
+        RF_BO = BIT(6),
+        RF_CO = BIT(7),
+        RF_DO = BIT(8),
+        RF_FO = BIT(9),
+        // /register file
+        
+        // load store unit
+        LSU_RE = BIT(10),
+        LSU_WE = BIT(11),
+        LSU_SP_D = BIT(12), //stack * direction, 1 = decrement
+        LSU_SP_WE = BIT(13),
+        LSU_SP_EN = BIT(14),
+        LSU_SP_LD = BIT(39), //load stack pointer from the address bus
+        // /load store unit
+        
+        // arithmetic logic unit
+        ALU_ADD = BIT(15),
+        ALU_SUB = BIT(16),
+        ALU_AND = BIT(17),
+        ALU_OR = BIT(18),
+        ALU_NOT = BIT(19),
+        ALU_SHL = BIT(20),
+        ALU_SHR = BIT(21),
+        ALU_WA = BIT(22),
+        ALU_WB = BIT(23),
+        ALU_OE = BIT(24),
+        // /arithmetic logic unit
+        
+        // instruction register
+        IR_WE = BIT(25),
+        // /instruction register
+        
+        // program counter
+        PC_LRC = BIT(26),
+        PC_INI = BIT(27),
+        PC_CUB = BIT(28),
+        PC_OE = BIT(29),
+        PC_VEC = BIT(38), //load the interrupt vector
+        // /program counter
+        
+        // address composition unit
+        ACU_WL = BIT(30),
+        ACU_WH = BIT(31),
+        ACU_OE = BIT(32),
+        ACU_INC = BIT(36), //increment composed address after this step
+        ACU_DEC = BIT(37), //decrement composed address after this step
+        ACU_BANK = BIT(40), //latch the bank register, the upper address byte of ACU-addressed loads and stores
+        ACU_LD = BIT(41), //load the composed address from the address bus
+        ACU_ADD = BIT(42), //add the data bus to the composed address, after ACU_LD in the same step
+        // /address composition unit
+        
+        // address decomposition unit
+        ADU_RL = BIT(33),
+        ADU_RH = BIT(34),
+        ADU_WE = BIT(35),
+        // /address decomposition unit
+        
+        // free-running counters (mode_flag encoding only)
+        CNT_OL = BIT(43), //drive the low byte of the selected counter, hold its upper bytes for CNT_OH
+        CNT_OH = BIT(44), //drive the next held byte
+        CNT_SEL = BIT(45), //select the retired-instruction counter instead of the cycle counter
+        // /free-running counters
+        
+        // misc
+        INT_EI = BIT(50), //enable interrupt requests
+        INT_DI = BIT(51), //disable interrupt requests
+        SET_STEP = BIT(52), //enter single-step mode (mode_flag encoding only)
+        CLR_STEP = BIT(53), //leave single-step mode (mode_flag encoding only)
+        FORCE_JUMP = BIT(54),
+        REQUEST_JEZ = BIT(55),
+        REQUEST_JCS = BIT(56),
+        CONNECT_FB = BIT(57),
+        OUT_Q1 = BIT(58),
+        OUT_Q2 = BIT(59),
+        SET_HALT = BIT(60),
+        // /misc
+    };
+    
+    constexpr const auto FETCH_INSTRUCTION = PC_OE | LSU_RE | IR_WE,
+                                LSU_SP_INC = LSU_SP_EN | LSU_SP_WE,
+                                LSU_SP_DEC = LSU_SP_EN | LSU_SP_WE | LSU_SP_D,
+                            LSU_READ_STACK = LSU_SP_EN | LSU_RE,
+                           LSU_WRITE_STACK = LSU_SP_EN | LSU_WE;
+    
+    // table rows the sequencer enters by itself rather than through a fetched opcode, no opcode or trapping duplicate may take them;
+    // it starts them at step 1 and their step 0 is the fetch that hands over to the next instruction
+    enum : std::uint8_t
+    {
+        ROW_IRQ = 0xFE,
+        ROW_RESET = 0xFF,
+    };
+    
+    constexpr const auto IRQ_VECTOR = std::uint16_t{ 0x0010 };
+    
+    enum : std::uint8_t
+    {
+        FLAG_C = 0x01, //carry out of the last ALU operation, borrow for ALU_SUB
+        FLAG_Z = 0x02, //result of the last ALU operation was zero
+        FLAG_H = 0x08, //halted, the first board's only halt latch, written with C and Z cleared
+    };
+    
+    consteval auto chk_trap(bool trap) noexcept
+    {
+        return trap ? SET_HALT : 0;
+    }
+    
+    consteval µcode_line emit_mvb(µcode_type dest_in, µcode_type src_out, bool fmode, bool trap) noexcept
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | src_out | dest_in | (fmode ? CONNECT_FB : 0),
+            LEN(1) | PC_INI | chk_trap(trap),
+            
+            0ull, 0ull, 0ull, 0ull, 0ull,
+        };
+    }
+    
+    consteval µcode_line emit_alu2reg(µcode_type dest_in, µcode_type dest_out, µcode_type src_out, µcode_type op, bool trap) noexcept
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | dest_out | ALU_WA,
+            LEN(1) | src_out | ALU_WB,
+            LEN(1) | op | ALU_OE | dest_in | RF_FI,
+            LEN(1) | PC_INI | chk_trap(trap),
+            
+            0ull, 0ull, 0ull,
+        };
+    }
+    
+    consteval µcode_line emit_aluimm(µcode_type dest_in, µcode_type dest_out, µcode_type op, bool trap) noexcept
+    {
+        return
+        {
+            LEN(2) | FETCH_INSTRUCTION,
+            LEN(2) | dest_out | ALU_WA,
+            LEN(2) | OUT_Q1 | ALU_WB,
+            LEN(2) | op | ALU_OE | dest_in | RF_FI,
+            LEN(2) | PC_INI | chk_trap(trap),
+            
+            0ull, 0ull, 0ull,
+        };
+    }
+    
+    consteval µcode_line emit_alunot(µcode_type dest_in, µcode_type dest_out, bool trap) noexcept
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | dest_out | ALU_WA,
+            LEN(1) | ALU_NOT | ALU_OE | dest_in | RF_FI,
+            LEN(1) | PC_INI | chk_trap(trap),
+            
+            0ull, 0ull, 0ull, 0ull,
+        };
+    }
+    
+    consteval µcode_line emit_nop(bool trap) noexcept
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | PC_INI | chk_trap(trap),
+            
+            0ull, 0ull, 0ull, 0ull, 0ull, 0ull,
+        };
+    }
+    
+    //doesn't accept trapping
+    consteval µcode_line emit_brk(void) noexcept
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | PC_INI | SET_HALT,
+            
+            0ull, 0ull, 0ull, 0ull, 0ull, 0ull,
+        };
+    }
+    
+    //latches a CPU mode, the single-step modes only exist in the mode_flag encoding
+    consteval µcode_line emit_mode(µcode_type mode) noexcept
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | PC_INI | mode,
+            
+            0ull, 0ull, 0ull, 0ull, 0ull, 0ull,
+        };
+    }
+    
+    consteval µcode_line emit_ldbimm(µcode_type dest_in, bool trap) noexcept
+    {
+        return
+        {
+            LEN(2) | FETCH_INSTRUCTION,
+            LEN(2) | OUT_Q1 | dest_in,
+            LEN(2) | PC_INI | chk_trap(trap),
+            
+            0ull, 0ull, 0ull, 0ull, 0ull,
+        };
+    }
+    
+    consteval µcode_line emit_ldbmem(µcode_type dest_in, bool trap) noexcept
+    {
+        return
+        {
+            LEN(3) | FETCH_INSTRUCTION,
+            LEN(3) | OUT_Q1 | ACU_WL,
+            LEN(3) | OUT_Q2 | ACU_WH,
+            LEN(3) | ACU_OE | LSU_RE | dest_in,
+            LEN(3) | PC_INI | chk_trap(trap),
+            
+            0ull, 0ull, 0ull,
+        };
+    }
+    
+    consteval µcode_line emit_stbmem(µcode_type src_out, bool trap) noexcept
+    {
+        return
+        {
+            LEN(3) | FETCH_INSTRUCTION,
+            LEN(3) | OUT_Q1 | ACU_WL,
+            LEN(3) | OUT_Q2 | ACU_WH,
+            LEN(3) | ACU_OE | LSU_WE | src_out,
+            LEN(3) | PC_INI | chk_trap(trap),
+            
+            0ull, 0ull, 0ull,
+        };
+    }
+    
+    consteval µcode_line emit_pop8r(µcode_type dest_in, bool trap) noexcept
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | LSU_READ_STACK | dest_in,
+            LEN(1) | LSU_SP_INC,
+            LEN(1) | PC_INI | chk_trap(trap),
+            
+            0ull, 0ull, 0ull, 0ull,
+        };
+    }
+    
+    consteval µcode_line emit_push8r(µcode_type src_out, bool trap) noexcept
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | LSU_SP_DEC,
+            LEN(1) | LSU_WRITE_STACK | src_out,
+            LEN(1) | PC_INI | chk_trap(trap),
+            
+            0ull, 0ull, 0ull, 0ull,
+        };
+    }
+    
+    
+    consteval µcode_line emit_popip(bool trap) noexcept
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | LSU_READ_STACK | ACU_WL,
+            LEN(1) | LSU_SP_INC,
+            LEN(1) | LSU_READ_STACK | ACU_WH,
+            LEN(1) | LSU_SP_INC,
+            LEN(1) | ACU_OE | PC_LRC | FORCE_JUMP,
+            LEN(1) | PC_INI | chk_trap(trap),
+            
+            0ull,
+        };
+    }
+    
+    consteval µcode_line emit_puship(bool trap) noexcept
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | PC_OE | ADU_WE,
+            LEN(1) | LSU_SP_DEC,
+            LEN(1) | LSU_WRITE_STACK | ADU_RH,
+            LEN(1) | LSU_SP_DEC,
+            LEN(1) | LSU_WRITE_STACK | ADU_RL,
+            LEN(1) | PC_INI | chk_trap(trap),
+            
+            0ull,
+        };
+    }
+    
+    //only exists in the mode_flag encoding, the bank applies from the next instruction's data accesses on
+    consteval µcode_line emit_bank(µcode_type src_out, unsigned int length) noexcept
+    {
+        return
+        {
+            LEN(length) | FETCH_INSTRUCTION,
+            LEN(length) | src_out | ACU_BANK,
+            LEN(length) | PC_INI,
+            
+            0ull, 0ull, 0ull, 0ull, 0ull,
+        };
+    }
+    
+    //only exists in the mode_flag encoding, addresses SP plus the unsigned operand byte
+    consteval µcode_line emit_ldbsp(µcode_type dest_in) noexcept
+    {
+        return
+        {
+            LEN(2) | FETCH_INSTRUCTION,
+            LEN(2) | LSU_SP_EN | ACU_LD | OUT_Q1 | ACU_ADD,
+            LEN(2) | ACU_OE | LSU_RE | dest_in,
+            LEN(2) | PC_INI,
+            
+            0ull, 0ull, 0ull, 0ull,
+        };
+    }
+    
+    //only exists in the mode_flag encoding, addresses SP plus the unsigned operand byte
+    consteval µcode_line emit_stbsp(µcode_type src_out) noexcept
+    {
+        return
+        {
+            LEN(2) | FETCH_INSTRUCTION,
+            LEN(2) | LSU_SP_EN | ACU_LD | OUT_Q1 | ACU_ADD,
+            LEN(2) | ACU_OE | LSU_WE | src_out,
+            LEN(2) | PC_INI,
+            
+            0ull, 0ull, 0ull, 0ull,
+        };
+    }
+    
+    //only exists in the mode_flag encoding, reads a 16-bit counter window into a register pair, low byte first
+    consteval µcode_line emit_counter(µcode_type low_out, µcode_type lo_in, µcode_type hi_in) noexcept
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | low_out | lo_in,
+            LEN(1) | CNT_OH | hi_in,
+            LEN(1) | PC_INI,
+            
+            0ull, 0ull, 0ull, 0ull,
+        };
+    }
+    
+    //entered by the sequencer on reset, with both buses idle (zero) PC, SP, flags and any modes latched from the bus all start from 0;
+    //step 0 then primes IR from the reset vector like any other handover
+    consteval µcode_line emit_reset(µcode_type modes) noexcept
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | PC_LRC | FORCE_JUMP | LSU_SP_LD | RF_FI | CONNECT_FB | modes,
+            
+            0ull, 0ull, 0ull, 0ull, 0ull, 0ull,
+        };
+    }
+    
+    //entered by the sequencer at an instruction boundary, pushes IP and flags on top of the PUSH_IP sequence
+    consteval µcode_line emit_irq(void) noexcept
+    {
+        auto µinsn = emit_puship(false);
+        
+        µinsn[1] |= PC_VEC | INT_DI;
+        µinsn[6] = LEN(1) | LSU_SP_DEC;
+        µinsn[7] = LEN(1) | LSU_WRITE_STACK | RF_FO | CONNECT_FB;
+        
+        return µinsn;
+    }
+    
+    consteval µcode_line emit_reti(void) noexcept
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | LSU_READ_STACK | RF_FI | CONNECT_FB,
+            LEN(1) | LSU_SP_INC,
+            LEN(1) | LSU_READ_STACK | ACU_WL,
+            LEN(1) | LSU_SP_INC,
+            LEN(1) | LSU_READ_STACK | ACU_WH,
+            LEN(1) | LSU_SP_INC,
+            LEN(1) | ACU_OE | PC_LRC | FORCE_JUMP | INT_EI,
+        };
+    }
+    
+    consteval µcode_line emit_jump(µcode_type condition, bool trap) noexcept
+    {
+        return
+        {
+            LEN(3) | FETCH_INSTRUCTION,
+            LEN(3) | OUT_Q1 | ACU_WL,
+            LEN(3) | OUT_Q2 | ACU_WH,
+            LEN(3) | ACU_OE | PC_LRC | condition | chk_trap(trap),
+            
+            0ull, 0ull, 0ull, 0ull,
+        };
+    }
+    
+    consteval µcode_line emit_deref(µcode_type src1_out, µcode_type src2_out, µcode_type dest_in, bool trap)
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | src1_out | ACU_WL,
+            LEN(1) | src2_out | ACU_WH,
+            LEN(1) | ACU_OE | LSU_RE | dest_in,
+            LEN(1) | PC_INI | chk_trap(trap),
+            
+            0ull, 0ull, 0ull,
+        };
+    }
+    
+    
+    // post-increment: access through the pointer, then write pointer + 1 back through the ADU
+    consteval µcode_line emit_ptr_inc(µcode_type src1_out, µcode_type src2_out, µcode_type src1_in, µcode_type src2_in, µcode_type access, bool trap) noexcept
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | src1_out | ACU_WL,
+            LEN(1) | src2_out | ACU_WH,
+            LEN(1) | ACU_OE | access | ACU_INC,
+            LEN(1) | ACU_OE | ADU_WE,
+            LEN(1) | ADU_RL | src1_in,
+            LEN(1) | ADU_RH | src2_in,
+            LEN(1) | PC_INI | chk_trap(trap),
+        };
+    }
+    
+    // pre-decrement: step the pointer down first, then access and write it back in the same cycle
+    consteval µcode_line emit_ptr_dec(µcode_type src1_out, µcode_type src2_out, µcode_type src1_in, µcode_type src2_in, µcode_type access, bool trap) noexcept
+    {
+        return
+        {
+            LEN(1) | FETCH_INSTRUCTION,
+            LEN(1) | src1_out | ACU_WL,
+            LEN(1) | src2_out | ACU_WH,
+            LEN(1) | ACU_DEC,
+            LEN(1) | ACU_OE | access | ADU_WE,
+            LEN(1) | ADU_RL | src1_in,
+            LEN(1) | ADU_RH | src2_in,
+            LEN(1) | PC_INI | chk_trap(trap),
+        };
+    }
+    
+    
+    // a conditional jump row specialised for known flags, taken becomes forced and untaken skips the operand
+    constexpr µcode_line resolve_condition(const µcode_line& µinsn, std::uint8_t flags) noexcept
+    {
+        auto condition = µcode_type{ 0 }, halt = µcode_type{ 0 };
+        
+        for (const auto µop : µinsn)
+        {
+            condition |= µop & (REQUEST_JEZ | REQUEST_JCS);
+            halt |= µop & SET_HALT;
+        }
+        
+        if (condition == 0)
+        {
+            return µinsn;
+        }
+        
+        if (((condition & REQUEST_JEZ) && (flags & FLAG_Z)) || ((condition & REQUEST_JCS) && (flags & FLAG_C)))
+        {
+            auto taken = µinsn;
+            
+            for (auto& µop : taken)
+            {
+                µop = (µop & condition) ? ((µop & ~condition) | FORCE_JUMP) : µop;
+            }
+            
+            return taken;
+        }
+        
+        return { µinsn[0], (µinsn[0] & LEN(3)) | PC_INI | halt, 0ull, 0ull, 0ull, 0ull, 0ull, 0ull };
+    }
+    
+    enum class trap_encoding
+    {
+        opcode_bit, //bit 0x80 of the opcode selects a SET_HALT duplicate of every instruction
+        mode_flag,  //single-stepping is a CPU mode, opcodes 0x80-0xFF hold extended instructions
+    };
+    
+    consteval auto is_extended(unsigned int opcode) noexcept
+    {
+        return (opcode & 0x80) != 0;
+    }
+    
+    // every mnemonic opcode.h defines: the base instructions, which opcode_bit duplicates with SET_HALT at op | 0x80,
+    // the pointer forms and interrupt control, which both encodings hold once in rows no base instruction or duplicate
+    // takes, and the extended instructions only mode_flag has room for
+#define ISA_BASE(X) \
+    X(NOP) X(BRK) X(MVB_A_B) X(MVB_A_C) X(MVB_A_D) X(MVB_A_F) X(MVB_B_A) X(MVB_B_C) X(MVB_B_D) \
+    X(MVB_B_F) X(MVB_C_A) X(MVB_C_B) X(MVB_C_D) X(MVB_C_F) X(MVB_D_A) X(MVB_D_B) X(MVB_D_C) \
+    X(MVB_D_F) X(ADC_A_B) X(SBB_A_B) X(AND_A_B) X(LOR_A_B) X(ADC_A_C) X(SBB_A_C) X(AND_A_C) \
+    X(LOR_A_C) X(ADC_A_D) X(SBB_A_D) X(AND_A_D) X(LOR_A_D) X(ADC_B_A) X(SBB_B_A) X(AND_B_A) \
+    X(LOR_B_A) X(ADC_B_C) X(SBB_B_C) X(AND_B_C) X(LOR_B_C) X(ADC_B_D) X(SBB_B_D) X(AND_B_D) \
+    X(LOR_B_D) X(ADC_C_A) X(SBB_C_A) X(AND_C_A) X(LOR_C_A) X(ADC_C_B) X(SBB_C_B) X(AND_C_B) \
+    X(LOR_C_B) X(ADC_C_D) X(SBB_C_D) X(AND_C_D) X(LOR_C_D) X(ADC_D_A) X(SBB_D_A) X(AND_D_A) \
+    X(LOR_D_A) X(ADC_D_B) X(SBB_D_B) X(AND_D_B) X(LOR_D_B) X(ADC_D_C) X(SBB_D_C) X(AND_D_C) \
+    X(LOR_D_C) X(ADC_A_IMM) X(SBB_A_IMM) X(AND_A_IMM) X(LOR_A_IMM) X(ROL_A_IMM) X(ROR_A_IMM) \
+    X(ADC_B_IMM) X(SBB_B_IMM) X(AND_B_IMM) X(LOR_B_IMM) X(ROL_B_IMM) X(ROR_B_IMM) X(ADC_C_IMM) \
+    X(SBB_C_IMM) X(AND_C_IMM) X(LOR_C_IMM) X(ROL_C_IMM) X(ROR_C_IMM) X(ADC_D_IMM) X(SBB_D_IMM) \
+    X(AND_D_IMM) X(LOR_D_IMM) X(ROL_D_IMM) X(ROR_D_IMM) X(NOT_A) X(NOT_B) X(NOT_C) X(NOT_D) \
+    X(LDB_A_IMM) X(LDB_A_MEM) X(LDB_B_IMM) X(LDB_B_MEM) X(LDB_C_IMM) X(LDB_C_MEM) X(LDB_D_IMM) \
+    X(LDB_D_MEM) X(STB_MEM_A) X(STB_MEM_B) X(STB_MEM_C) X(STB_MEM_D) X(PUSH_IP) X(POP_IP) X(PUSH_A) \
+    X(POP_A) X(PUSH_B) X(POP_B) X(PUSH_C) X(POP_C) X(PUSH_D) X(POP_D) X(JEZ_MEM) X(JCS_MEM) \
+    X(JMP_MEM) X(DEREF_AB_A) X(DEREF_CD_C)
+    
+#define ISA_POINTER(X) \
+    X(DEREF_AB_C_INC) X(DEREF_AB_C_DEC) X(DEREF_CD_A_INC) X(DEREF_CD_A_DEC) \
+    X(STORE_AB_C_INC) X(STORE_AB_C_DEC) X(STORE_CD_A_INC) X(STORE_CD_A_DEC)
+    
+#define ISA_INTERRUPT(X) \
+    X(EI) X(DI) X(RETI)
+    
+#define ISA_EXTENDED(X) \
+    X(STEP_ON) X(STEP_OFF) X(BANK_A) X(BANK_IMM) X(LDB_A_SP) X(LDB_B_SP) X(LDB_C_SP) X(LDB_D_SP) X(STB_SP_A) \
+    X(STB_SP_B) X(STB_SP_C) X(STB_SP_D) X(RDCYC_AB) X(RDCYC_CD) X(RDINS_AB) X(RDINS_CD) X(RDHI_AB) X(RDHI_CD)
+    
+    // the instructions without a trapping duplicate that are still in both encodings
+    constexpr bool is_single_row(unsigned int opcode) noexcept
+    {
+#define SINGLE_ROW(op) opcode == op ||
+        return ISA_POINTER(SINGLE_ROW) ISA_INTERRUPT(SINGLE_ROW) false;
+#undef SINGLE_ROW
+    }
+    
+    // a row of the opcode_bit table with bit 0x80 set is the trapping duplicate of row & 0x7F, unless either of them holds
+    // a pointer form or interrupt control or it belongs to the sequencer
+    constexpr bool is_trap_row(unsigned int row, trap_encoding encoding) noexcept
+    {
+        return encoding == trap_encoding::opcode_bit && (row & 0x80) && !is_single_row(row) && !is_single_row(row & 0x7F) &&
+               row != ROW_IRQ && row != ROW_RESET;
+    }
+    
+    // the instruction a row executes, trapping or not
+    constexpr unsigned int row_opcode(unsigned int row, trap_encoding encoding) noexcept
+    {
+        return is_trap_row(row, encoding) ? (row & 0x7F) : row;
+    }
+    
+    template<typename word, std::size_t width>
+    constexpr auto µcode_steps(const std::array<word, width>& µinsn) noexcept
+    {
+        auto steps = 0u;
+        
+        for (const auto& µop : µinsn)
+        {
+            steps += (µop != 0);
+        }
+        
+        return steps;
+    }
+    
+    // the emitters always produce this board's signal set, a layout policy maps each line onto another
+    // board's control word at compile time and decodes it back for the simulator
+    struct current_layout
+    {
+        static constexpr const auto id = std::uint8_t{ 0 };
+        static constexpr const auto unsupported = µcode_type{ 0 };
+        static constexpr const auto has_reset_row = true, latched_alu = false, shared_address_unit = false, stack_grows_up = false;
+        static constexpr const auto fetch_overlap = false, separate_address_bus = true, flag_addressed = false, halt_sets_flags = false;
+        
+        static constexpr const auto width = std::size_t{ µcode_line_width }, rows = std::size_t{ 0x100 }, fetch_steps = std::size_t{ 1 };
+        
+        static constexpr µcode_line translate(const µcode_line& µinsn) noexcept
+        {
+            return µinsn;
+        }
+        
+        static constexpr µcode_type decode(µcode_type µop) noexcept
+        {
+            return µop;
+        }
+    };
+    
+    // interrupt entry needs the vector and enable signals, and an instruction boundary where the PC has not yet moved on to
+    // the next fetch
+    template<typename layout>
+    constexpr bool has_interrupts = (layout::unsupported & (PC_VEC | INT_EI | INT_DI)) == 0 && !layout::fetch_overlap;
+    
+    // reached during constant evaluation only when two instructions are given the same row, which fails the build
+    inline void µcode_row_taken_twice(void) noexcept
+    {
+    }
+    
+    template<trap_encoding encoding = trap_encoding::opcode_bit, typename layout = current_layout>
+    constexpr auto write_µcode(void) noexcept
+    {
+        static_assert(encoding == trap_encoding::opcode_bit || (layout::unsupported & (SET_STEP | CLR_STEP)) == 0,
+                      "the mode_flag encoding needs single-step mode hardware");
+        
+        constexpr auto NTRAP = 0x00, TRAP = 0x80;
+        
+        // the sequencer's own rows stay out of the ISA in every encoding, the retired count and the fuzzer's and WCET's opcode scans skip them
+#define RESERVED_ROWS(op) static_assert(unsigned{ op } != ROW_IRQ && unsigned{ op } != ROW_RESET, #op " takes a row the sequencer enters by itself");
+#define RESERVED_TRAP_ROWS(op) static_assert((op | TRAP) != ROW_IRQ && (op | TRAP) != ROW_RESET, \
+                                             "the trapping " #op " takes a row the sequencer enters by itself");
+        ISA_BASE(RESERVED_ROWS)
+        ISA_POINTER(RESERVED_ROWS)
+        ISA_INTERRUPT(RESERVED_ROWS)
+        ISA_EXTENDED(RESERVED_ROWS)
+        
+        if constexpr (encoding == trap_encoding::opcode_bit)
+        {
+            ISA_BASE(RESERVED_TRAP_ROWS)
+        }
+#undef RESERVED_TRAP_ROWS
+#undef RESERVED_ROWS
+        
+        µcode_table µcode{};
+        
+        const auto place = [&](std::size_t row, const µcode_line& µinsn)
+        {
+            if (µcode_steps(µcode[row]) != 0)
+            {
+                µcode_row_taken_twice();
+            }
+            
+            µcode[row] = µinsn;
+        };
+        
+#define TRAPPABLE(op, emit, ...) place(op | NTRAP, emit(__VA_ARGS__ __VA_OPT__(,) false)); \
+                                 if constexpr (encoding == trap_encoding::opcode_bit) place(op | TRAP, emit(__VA_ARGS__ __VA_OPT__(,) true));
+        // misc
+        {
+            TRAPPABLE(NOP, emit_nop)
+            
+            place(BRK | NTRAP, emit_brk());
+        }
+        
+#define CREATE_MVB_X_Y(x, y, z) TRAPPABLE(MVB_##x##_##y, emit_mvb, RF_##x##I, RF_##y##O, z)
+        // r0 -> other register moving
+        {
+            CREATE_MVB_X_Y(A, B, false)
+            CREATE_MVB_X_Y(A, C, false)
+            CREATE_MVB_X_Y(A, D, false)
+            CREATE_MVB_X_Y(A, F, true)
+        }
+        
+        // r1 -> other register moving
+        {
+            CREATE_MVB_X_Y(B, A, false)
+            CREATE_MVB_X_Y(B, C, false)
+            CREATE_MVB_X_Y(B, D, false)
+            CREATE_MVB_X_Y(B, F, true)
+        }
+        
+        // r2 -> other register moving
+        {
+            CREATE_MVB_X_Y(C, A, false)
+            CREATE_MVB_X_Y(C, B, false)
+            CREATE_MVB_X_Y(C, D, false)
+            CREATE_MVB_X_Y(C, F, true)
+        }
+        
+        // r3 -> other register moving
+        {
+            CREATE_MVB_X_Y(D, A, false)
+            CREATE_MVB_X_Y(D, B, false)
+            CREATE_MVB_X_Y(D, C, false)
+            CREATE_MVB_X_Y(D, F, true)
+        }
+#undef CREATE_MVB_X_Y
+        
+        
+#define CREATE_ALUR_X_Y(x, y, o, w) TRAPPABLE(w##_##x##_##y, emit_alu2reg, RF_##x##I, RF_##x##O, RF_##y##O, o)
+#define ENUM_ALUR(x, y) CREATE_ALUR_X_Y(x, y, ALU_ADD, ADC) \
+                        CREATE_ALUR_X_Y(x, y, ALU_SUB, SBB) \
+                        CREATE_ALUR_X_Y(x, y, ALU_AND, AND) \
+                        CREATE_ALUR_X_Y(x, y, ALU_OR,  LOR)
+        {
+            ENUM_ALUR(A, B)
+            ENUM_ALUR(A, C)
+            ENUM_ALUR(A, D)
+            
+            ENUM_ALUR(B, A)
+            ENUM_ALUR(B, C)
+            ENUM_ALUR(B, D)
+            
+            ENUM_ALUR(C, A)
+            ENUM_ALUR(C, B)
+            ENUM_ALUR(C, D)
+            
+            ENUM_ALUR(D, A)
+            ENUM_ALUR(D, B)
+            ENUM_ALUR(D, C)
+        }
+#undef ENUM_ALUR
+#undef CREATE_ALUR_X_Y
+        
+        //µcode_type dest_in, µcode_type dest_out, µcode_type op, bool trap
+#define CREATE_ALUI_X(x, o, w) TRAPPABLE(w##_##x##_IMM, emit_aluimm, RF_##x##I, RF_##x##O, o)
+#define ENUM_ALUI(x) CREATE_ALUI_X(x, ALU_ADD, ADC) \
+                     CREATE_ALUI_X(x, ALU_SUB, SBB) \
+                     CREATE_ALUI_X(x, ALU_AND, AND) \
+                     CREATE_ALUI_X(x, ALU_OR,  LOR) \
+                     CREATE_ALUI_X(x, ALU_SHL, ROL) \
+                     CREATE_ALUI_X(x, ALU_SHR, ROR)
+        {
+            ENUM_ALUI(A)
+            ENUM_ALUI(B)
+            ENUM_ALUI(C)
+            ENUM_ALUI(D)
+        }
+#undef ENUM_ALUI
+#undef CREATE_ALUI_X
+        
+        
+#define CREATE_ALU_NOT(x) TRAPPABLE(NOT_##x, emit_alunot, RF_##x##I, RF_##x##O)
+        {
+            CREATE_ALU_NOT(A)
+            CREATE_ALU_NOT(B)
+            CREATE_ALU_NOT(C)
+            CREATE_ALU_NOT(D)
+        }
+#undef CREATE_ALU_NOT
+        
+        
+#define CREATE_LDB(x) TRAPPABLE(LDB_##x##_IMM, emit_ldbimm, RF_##x##I) \
+                      TRAPPABLE(LDB_##x##_MEM, emit_ldbmem, RF_##x##I)
+        {
+            CREATE_LDB(A)
+            CREATE_LDB(B)
+            CREATE_LDB(C)
+            CREATE_LDB(D)
+        }
+#undef CREATE_LDB
+        
+        //µcode_type src_out, bool trap
+#define CREATE_STB(x) TRAPPABLE(STB_MEM_##x, emit_stbmem, RF_##x##O)
+        {
+            CREATE_STB(A)
+            CREATE_STB(B)
+            CREATE_STB(C)
+            CREATE_STB(D)
+        }
+#undef CREATE_STB
+        
+        
+        TRAPPABLE(PUSH_IP, emit_puship)
+        TRAPPABLE(POP_IP, emit_popip)
+        
+#define CREATE_STACKR(x) TRAPPABLE(PUSH_##x, emit_push8r, RF_##x##O) \
+                         TRAPPABLE(POP_##x, emit_pop8r, RF_##x##I)
+        {
+            CREATE_STACKR(A)
+            CREATE_STACKR(B)
+            CREATE_STACKR(C)
+            CREATE_STACKR(D)
+        }
+#undef CREATE_STACKR
+        
+        TRAPPABLE(JEZ_MEM, emit_jump, REQUEST_JEZ)
+        TRAPPABLE(JCS_MEM, emit_jump, REQUEST_JCS)
+        TRAPPABLE(JMP_MEM, emit_jump, FORCE_JUMP)
+        
+        
+        TRAPPABLE(DEREF_AB_A, emit_deref, RF_AO, RF_BO, RF_AI)
+        TRAPPABLE(DEREF_CD_C, emit_deref, RF_CO, RF_DO, RF_CI)
+#undef TRAPPABLE
+        
+        
+        // the pointer forms have no trapping duplicate, so opcode_bit fits them into the rows base instructions leave free;
+        // the first board has no address incrementer and goes without them
+        if constexpr ((layout::unsupported & (ACU_INC | ACU_DEC)) == 0)
+        {
+            //µcode_type src1_out, µcode_type src2_out, µcode_type src1_in, µcode_type src2_in, µcode_type access, bool trap
+#define CREATE_PTR_X_Y(x, y, z, w) place(x##_##y##w##_##z##_INC, emit_ptr_inc(RF_##y##O, RF_##w##O, RF_##y##I, RF_##w##I, access, false)); \
+                                   place(x##_##y##w##_##z##_DEC, emit_ptr_dec(RF_##y##O, RF_##w##O, RF_##y##I, RF_##w##I, access, false));
+            // pointer in AB streams through C, pointer in CD streams through A
+            {
+                constexpr auto access = LSU_RE | RF_CI;
+                CREATE_PTR_X_Y(DEREF, A, C, B)
+            }
+            {
+                constexpr auto access = LSU_WE | RF_CO;
+                CREATE_PTR_X_Y(STORE, A, C, B)
+            }
+            {
+                constexpr auto access = LSU_RE | RF_AI;
+                CREATE_PTR_X_Y(DEREF, C, A, D)
+            }
+            {
+                constexpr auto access = LSU_WE | RF_AO;
+                CREATE_PTR_X_Y(STORE, C, A, D)
+            }
+#undef CREATE_PTR_X_Y
+        }
+        
+        
+        // interrupt control only needs the vector and enable signals, so opcode_bit keeps it in rows base instructions leave free too
+        if constexpr (has_interrupts<layout>)
+        {
+            place(EI, emit_mode(INT_EI));
+            place(DI, emit_mode(INT_DI));
+            place(RETI, emit_reti());
+            place(ROW_IRQ, emit_irq());
+        }
+        
+        
+        if constexpr (encoding == trap_encoding::mode_flag)
+        {
+            place(ROW_RESET, emit_reset(INT_DI | CLR_STEP | ACU_BANK));
+        }
+        
+        else if constexpr (layout::has_reset_row)
+        {
+            place(ROW_RESET, emit_reset(has_interrupts<layout> ? INT_DI : 0));
+        }
+        
+        
+        // extended instructions, only reachable once the trap bit is reclaimed
+        if constexpr (encoding == trap_encoding::mode_flag)
+        {
+            static_assert(is_extended(STEP_ON) && is_extended(STEP_OFF));
+            
+            place(STEP_ON, emit_mode(SET_STEP));
+            place(STEP_OFF, emit_mode(CLR_STEP));
+            
+            static_assert(is_extended(BANK_A) && is_extended(BANK_IMM));
+            
+            place(BANK_A, emit_bank(RF_AO, 1));
+            place(BANK_IMM, emit_bank(OUT_Q1, 2));
+            
+            
+#define CREATE_SPREL(x) static_assert(is_extended(LDB_##x##_SP) && is_extended(STB_SP_##x)); \
+                        place(LDB_##x##_SP, emit_ldbsp(RF_##x##I)); \
+                        place(STB_SP_##x, emit_stbsp(RF_##x##O));
+            {
+                CREATE_SPREL(A)
+                CREATE_SPREL(B)
+                CREATE_SPREL(C)
+                CREATE_SPREL(D)
+            }
+#undef CREATE_SPREL
+            
+            
+            static_assert(is_extended(RDCYC_AB) && is_extended(RDCYC_CD) && is_extended(RDINS_AB) && is_extended(RDINS_CD) &&
+                          is_extended(RDHI_AB) && is_extended(RDHI_CD));
+            {
+                place(RDCYC_AB, emit_counter(CNT_OL, RF_AI, RF_BI));
+                place(RDCYC_CD, emit_counter(CNT_OL, RF_CI, RF_DI));
+                place(RDINS_AB, emit_counter(CNT_OL | CNT_SEL, RF_AI, RF_BI));
+                place(RDINS_CD, emit_counter(CNT_OL | CNT_SEL, RF_CI, RF_DI));
+                
+                //bits 16 to 31 of whichever counter was read last
+                place(RDHI_AB, emit_counter(CNT_OH, RF_AI, RF_BI));
+                place(RDHI_CD, emit_counter(CNT_OH, RF_CI, RF_DI));
+            }
+        }
+        
+        // flag-addressed sequencers take C and Z from the fetch as row bits 8 and 9
+        auto table = layout_table<layout>{};
+        
+        for (auto row = std::size_t{ 0 }; row < table.size(); ++row)
+        {
+            const auto& µinsn = µcode[row & 0xFF];
+            table[row] = layout::translate(layout::flag_addressed ? resolve_condition(µinsn, static_cast<std::uint8_t>(row >> 8)) : µinsn);
+        }
+        
+        return table;
+    }
+    
+    // the table as it is burned into the ROM, evaluated once at compile time and linked in as read-only data
+    template<trap_encoding encoding = trap_encoding::opcode_bit, typename layout = current_layout>
+    constexpr const auto encoded_µcode = write_µcode<encoding, layout>();
+}
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <array>
+
+#include "microcode.h"
+#include "simulator.h"
+#include "devices.h"
+
+namespace
+{
+    enum class topology : std::uint8_t
+    {
+        ring, pairs,
+    };
+    
+    struct network_options
+    {
+        std::size_t boards = 64;
+        unsigned int threads = 0; //all hardware threads when 0
+        std::uint64_t cycles = 10'000'000; //per board
+        std::uint64_t quantum = 1'000;
+        std::uint64_t latency = 1'000; //shortest cycles a byte spends on a link, at least one quantum
+        std::uint64_t jitter = 0; //extra link latency drawn per link from the seed
+        std::uint64_t seed = 1;
+        std::uint16_t uart = 0xF000;
+        topology wiring = topology::ring;
+        bool private_tables = false; //every board gets its own copy of the microcode instead of sharing the compiled-in one
+    };
+    
+    inline std::uint64_t splitmix64(std::uint64_t& state) noexcept
+    {
+        auto z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    
+    // every board runs the same image and finds its station address in the UART; board i transmits to board i + 1
+    // around a ring, or to its partner in pairs, over a link that only it writes and only the receiver reads
+    //
+    // boards run in quanta across a fixed pool of threads and meet at a barrier after each one; a receiver takes a
+    // byte off its link at the start of the quantum it is due in, and with latencies of at least one quantum that
+    // byte was sent in an earlier quantum, so what a board sees does not depend on how the threads interleave
+    template<trap_encoding encoding, typename layout>
+    class network
+    {
+    public:
+        using board = simulator<encoding, layout>;
+        
+        network(const std::vector<std::uint8_t>& image, const network_options& options) : options(options)
+        {
+            auto random = options.seed;
+            
+            // a byte waits on its link for at most its latency and a quantum, and a store to the UART takes at least two cycles,
+            // so a link sized for that never overruns and never makes a board depend on when its receiver drained
+            const auto capacity = static_cast<std::size_t>((options.latency + options.jitter + 2 * options.quantum) / 2 + 1);
+            
+            for (auto i = std::size_t{ 0 }; i < options.boards; ++i)
+            {
+                if (options.private_tables)
+                {
+                    tables.push_back(std::make_unique<layout_table<layout>>(decoded_µcode<encoding, layout>));
+                }
+                
+                boards.push_back(std::make_unique<board>(options.private_tables ? *tables.back() : decoded_µcode<encoding, layout>));
+                links.push_back(std::unique_ptr<uart_link>(new uart_link{ spsc_queue<uart_message>(capacity), options.latency + splitmix64(random) % (options.jitter + 1) }));
+                
+                auto& sim = *boards.back();
+                
+                std::copy(image.begin(), image.end(), sim.memory.begin());
+                sim.map.add_device(device::uart, options.uart);
+                sim.map.uart.station = static_cast<std::uint16_t>(i);
+                sim.map.uart.link = links.back().get();
+            }
+            
+            for (auto i = std::size_t{ 0 }; i < options.boards; ++i)
+            {
+                receiver.push_back((options.wiring == topology::ring) ? (i + 1) % options.boards : i ^ 1);
+                sender.push_back(0);
+            }
+            
+            for (auto i = std::size_t{ 0 }; i < options.boards; ++i)
+            {
+                sender[receiver[i]] = i;
+            }
+        }
+        
+        std::vector<std::unique_ptr<board>> boards{};
+        std::vector<std::unique_ptr<uart_link>> links{}; //links[i] carries what board i transmits
+        
+        std::uint64_t quanta = 0;
+        
+        void run(unsigned int threads)
+        {
+            auto next = std::atomic<std::size_t>{ 0 };
+            auto running = std::atomic<std::size_t>{ 0 };
+            auto finished = false;
+            auto end = std::min(options.quantum, options.cycles);
+            
+            // runs on one thread once all have arrived, before any is released into the next quantum
+            const auto advance = [&](void) noexcept
+            {
+                ++quanta;
+                finished = (running.exchange(0) == 0) || end == options.cycles;
+                end = std::min(end + options.quantum, options.cycles);
+                next = 0;
+            };
+            
+            auto sync = std::barrier(static_cast<std::ptrdiff_t>(threads), advance);
+            
+            const auto worker = [&](void)
+            {
+                while (true)
+                {
+                    for (auto i = next++; i < boards.size(); i = next++)
+                    {
+                        running += step(i, end);
+                    }
+                    
+                    sync.arrive_and_wait();
+                    
+                    if (finished)
+                    {
+                        return;
+                    }
+                }
+            };
+            
+            auto pool = std::vector<std::thread>{};
+            
+            for (auto t = 1u; t < threads; ++t)
+            {
+                pool.emplace_back(worker);
+            }
+            
+            worker();
+            
+            for (auto& thread : pool)
+            {
+                thread.join();
+            }
+        }
+    
+    private:
+        network_options options;
+        
+        std::vector<std::unique_ptr<layout_table<layout>>> tables{};
+        std::vector<std::size_t> receiver{}, sender{};
+        
+        // one board up to the end of the quantum, true while it has not halted
+        bool step(std::size_t i, std::uint64_t end) noexcept
+        {
+            auto& sim = *boards[i];
+            auto& incoming = links[sender[i]]->queue;
+            
+            while (const auto message = incoming.front())
+            {
+                if (message->cycle >= end)
+                {
+                    break;
+                }
+                
+                sim.map.uart.arriving.push_back(*message);
+                incoming.pop();
+            }
+            
+            while (sim.state.cycles < end && sim.clock());
+            
+            return !sim.state.halted;
+        }
+    };
+    
+    // FNV-1a over every board's registers, counters, serial traffic and memory, equal across runs with the same seed
+    template<typename machine>
+    std::uint64_t network_checksum(const std::vector<std::unique_ptr<machine>>& boards) noexcept
+    {
+        auto hash = 0xCBF29CE484222325ull;
+        
+        const auto mix = [&](std::uint64_t value)
+        {
+            for (auto byte = 0; byte < 8; ++byte, value >>= 8)
+            {
+                hash = (hash ^ (value & 0xFF)) * 0x100000001B3ull;
+            }
+        };
+        
+        for (const auto& sim : boards)
+        {
+            const auto& s = sim->state;
+            
+            for (const auto value : { std::uint64_t{ s.pc }, std::uint64_t{ s.sp }, std::uint64_t{ s.a }, std::uint64_t{ s.b }, std::uint64_t{ s.c },
+                                      std::uint64_t{ s.d }, std::uint64_t{ s.f }, s.cycles, s.retired, sim->map.uart.transmitted, sim->map.uart.overruns })
+            {
+                mix(value);
+            }
+            
+            for (const auto byte : sim->memory)
+            {
+                hash = (hash ^ byte) * 0x100000001B3ull;
+            }
+        }
+        
+        return hash;
+    }
+    
+    template<trap_encoding encoding, typename layout>
+    int run_network(const char* path, network_options options) noexcept
+    {
+        auto image = std::vector<std::uint8_t>(0x10000);
+        
+        if (auto file = std::fopen(path, "rb"))
+        {
+            image.resize(std::fread(image.data(), 1, image.size(), file));
+            std::fclose(file);
+        }
+        
+        else
+        {
+            std::fprintf(stderr, "[Error] File %s could not be opened for reading\nExiting...\n", path);
+            return EXIT_FAILURE;
+        }
+        
+        if (options.boards < 2 || (options.wiring == topology::pairs && options.boards % 2))
+        {
+            std::fprintf(stderr, "[Error] A network needs at least two boards, and an even number of them in pairs\nExiting...\n");
+            return EXIT_FAILURE;
+        }
+        
+        if (options.quantum == 0 || options.latency < options.quantum)
+        {
+            std::fprintf(stderr, "[Error] Link latency %llu is shorter than the %llu-cycle quantum, delivery would depend on thread timing\nExiting...\n",
+                         static_cast<unsigned long long>(options.latency), static_cast<unsigned long long>(options.quantum));
+            return EXIT_FAILURE;
+        }
+        
+        const auto threads = static_cast<unsigned int>(std::clamp<std::size_t>(options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency()), 1, options.boards));
+        auto net = std::make_unique<network<encoding, layout>>(image, options);
+        
+        const auto start = std::chrono::steady_clock::now();
+        net->run(threads);
+        const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        auto cycles = std::uint64_t{ 0 }, instructions = std::uint64_t{ 0 }, bytes = std::uint64_t{ 0 }, overruns = std::uint64_t{ 0 };
+        auto halted = std::size_t{ 0 };
+        
+        for (const auto& sim : net->boards)
+        {
+            cycles += sim->state.cycles;
+            instructions += sim->state.retired;
+            bytes += sim->map.uart.transmitted;
+            overruns += sim->map.uart.overruns;
+            halted += sim->state.halted;
+        }
+        
+        std::fprintf(stdout, "[Network] %zu boards on %u threads, %llu quanta of %llu cycles, %s tables\n", options.boards, threads,
+                     static_cast<unsigned long long>(net->quanta), static_cast<unsigned long long>(options.quantum), options.private_tables ? "private" : "shared");
+        std::fprintf(stdout, "[Network] %llu cycles, %llu instructions in %.2f s, %.2f M cycles/s, %zu boards halted\n",
+                     static_cast<unsigned long long>(cycles), static_cast<unsigned long long>(instructions), seconds,
+                     static_cast<double>(cycles) / seconds / 1e6, halted);
+        std::fprintf(stdout, "[Network] %llu bytes sent, %llu overruns, checksum %016llX\n", static_cast<unsigned long long>(bytes),
+                     static_cast<unsigned long long>(overruns), static_cast<unsigned long long>(network_checksum(net->boards)));
+        
+        return EXIT_SUCCESS;
+    }
+}
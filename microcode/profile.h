@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#include <array>
+
+#include "microcode.h"
+#include "simulator.h"
+#include "golden.h"
+
+namespace
+{
+    enum unit : std::size_t
+    {
+        UNIT_RF, UNIT_ALU, UNIT_LSU, UNIT_ACU, UNIT_ADU, UNIT_PC, UNIT_SP, UNIT_Q, UNIT_IR, UNIT_CNT,
+        UNIT_COUNT,
+    };
+    
+    constexpr const auto unit_names = std::to_array<const char*>({ "RF", "ALU", "LSU", "ACU", "ADU", "PC", "SP", "Q1/Q2", "IR", "CNT" });
+    
+    struct occupancy
+    {
+        std::uint64_t cycles = 0, data = 0, address = 0, idle = 0;
+        std::array<std::uint64_t, UNIT_COUNT> drives{}, latches{}, addresses{};
+        
+        // which units one control word puts on and takes off the buses, weighted by the cycles spent on it
+        void add(µcode_type µop, std::uint64_t count) noexcept
+        {
+            if (count == 0)
+            {
+                return;
+            }
+            
+            const auto flags_out = (µop & RF_FO) && (µop & CONNECT_FB);
+            const auto flags_in = (µop & RF_FI) && (µop & CONNECT_FB);
+            
+            const auto drive = std::array<bool, UNIT_COUNT>
+            {
+                (µop & (RF_AO | RF_BO | RF_CO | RF_DO)) || flags_out, (µop & ALU_OE) != 0, (µop & LSU_RE) != 0,
+                false, (µop & (ADU_RL | ADU_RH)) != 0, false, false, (µop & (OUT_Q1 | OUT_Q2)) != 0, false, (µop & (CNT_OL | CNT_OH)) != 0,
+            };
+            
+            const auto latch = std::array<bool, UNIT_COUNT>
+            {
+                (µop & (RF_AI | RF_BI | RF_CI | RF_DI)) || flags_in, (µop & (ALU_WA | ALU_WB)) != 0, (µop & LSU_WE) != 0,
+                (µop & (ACU_WL | ACU_WH | ACU_BANK | ACU_ADD)) != 0, false, false, false, false, (µop & IR_WE) != 0, false,
+            };
+            
+            const auto address_drive = std::array<bool, UNIT_COUNT>
+            {
+                false, false, false, (µop & ACU_OE) != 0, false, (µop & PC_OE) != 0, (µop & LSU_SP_EN) != 0, false, false, false,
+            };
+            
+            auto driven = false, latched = false, addressed = false;
+            
+            for (auto u = std::size_t{ 0 }; u < UNIT_COUNT; ++u)
+            {
+                drives[u] += drive[u] ? count : 0;
+                latches[u] += latch[u] ? count : 0;
+                addresses[u] += address_drive[u] ? count : 0;
+                
+                driven |= drive[u];
+                latched |= latch[u];
+                addressed |= address_drive[u];
+            }
+            
+            // an address is only useful to something that consumes it
+            const auto consumed = (µop & (LSU_RE | LSU_WE | IR_WE | ADU_WE | ACU_LD | LSU_SP_LD)) || ((µop & PC_LRC) && (µop & (ACU_OE | PC_OE)));
+            const auto data_transfer = driven && latched, address_transfer = addressed && consumed;
+            
+            cycles += count;
+            data += data_transfer ? count : 0;
+            address += address_transfer ? count : 0;
+            idle += (!data_transfer && !address_transfer) ? count : 0;
+        }
+    };
+    
+    inline double percent(std::uint64_t part, std::uint64_t whole) noexcept
+    {
+        return whole ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0.0;
+    }
+    
+    template<trap_encoding encoding, typename layout>
+    void print_profile(const simulator<encoding, layout>& sim, const layout_table<layout>& µcode) noexcept
+    {
+        auto total = occupancy{};
+        auto rows = std::array<occupancy, 0x100>{}; //flag-addressed variants of a row are summed
+        
+        for (auto row = std::size_t{ 0 }; row < µcode.size(); ++row)
+        {
+            for (auto step = std::size_t{ 0 }; step < layout::width; ++step)
+            {
+                const auto µop = expand_word<layout>(µcode[row][step]);
+                
+                rows[row & 0xFF].add(µop, (*sim.step_counts)[row][step]);
+                total.add(µop, (*sim.step_counts)[row][step]);
+            }
+        }
+        
+        std::fprintf(stdout, "[Profile] %llu cycles: data bus %.1f%%, address bus %.1f%%, no transfer %.1f%%\n",
+                     static_cast<unsigned long long>(total.cycles), percent(total.data, total.cycles),
+                     percent(total.address, total.cycles), percent(total.idle, total.cycles));
+        
+        const auto breakdown = [&](const char* what, const std::array<std::uint64_t, UNIT_COUNT>& counts)
+        {
+            std::fprintf(stdout, "[Profile] %-21s", what);
+            
+            for (auto u = std::size_t{ 0 }; u < UNIT_COUNT; ++u)
+            {
+                if (counts[u]) std::fprintf(stdout, " %s %.1f%%", unit_names[u], percent(counts[u], total.cycles));
+            }
+            
+            std::fprintf(stdout, "\n");
+        };
+        
+        breakdown("data bus driven by", total.drives);
+        breakdown("data bus latched by", total.latches);
+        breakdown("address bus driven by", total.addresses);
+        
+        // a row's step 0 is the fetch of the instruction after it
+        std::fprintf(stdout, "[Profile] %-16s %12s %7s %7s %7s %7s\n", "row", "cycles", "share", "data", "address", "idle");
+        
+        for (auto row = std::size_t{ 0 }; row < rows.size(); ++row)
+        {
+            const auto& r = rows[row];
+            
+            if (r.cycles == 0)
+            {
+                continue;
+            }
+            
+            const auto trap = is_trap_row(static_cast<unsigned int>(row), encoding);
+            const auto name = (row == ROW_RESET) ? "(reset)" : (row == ROW_IRQ) ? "(irq)" :
+                              mnemonic(row_opcode(static_cast<unsigned int>(row), encoding));
+            
+            std::fprintf(stdout, "[Profile] %s%-*s %12llu %6.1f%% %6.1f%% %6.1f%% %6.1f%%\n", trap ? "TRAP " : "", trap ? 11 : 16, name,
+                         static_cast<unsigned long long>(r.cycles), percent(r.cycles, total.cycles),
+                         percent(r.data, r.cycles), percent(r.address, r.cycles), percent(r.idle, r.cycles));
+        }
+    }
+}
@@ -0,0 +1,379 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "microcode.h"
+#include "legacy_layout.h"
+#include "vertical_layout.h"
+#include "golden.h"
+#include "rom_image.h"
+
+namespace
+{
+    // every one-hot signal of this board's control word, plus the result latch and halt immediate only the first board has
+#define SIGNALS(X) \
+    X(RF_AI) X(RF_BI) X(RF_CI) X(RF_DI) X(RF_FI) X(RF_AO) X(RF_BO) X(RF_CO) X(RF_DO) X(RF_FO) \
+    X(LSU_RE) X(LSU_WE) X(LSU_SP_D) X(LSU_SP_WE) X(LSU_SP_EN) X(LSU_SP_LD) \
+    X(ALU_ADD) X(ALU_SUB) X(ALU_AND) X(ALU_OR) X(ALU_NOT) X(ALU_SHL) X(ALU_SHR) X(ALU_WA) X(ALU_WB) X(ALU_OE) X(ALU_HOLD) \
+    X(IR_WE) X(PC_LRC) X(PC_INI) X(PC_CUB) X(PC_OE) X(PC_VEC) \
+    X(ACU_WL) X(ACU_WH) X(ACU_OE) X(ACU_INC) X(ACU_DEC) X(ACU_BANK) X(ACU_LD) X(ACU_ADD) X(ADU_RL) X(ADU_RH) X(ADU_WE) \
+    X(CNT_OL) X(CNT_OH) X(CNT_SEL) \
+    X(INT_EI) X(INT_DI) X(SET_STEP) X(CLR_STEP) X(FORCE_JUMP) X(REQUEST_JEZ) X(REQUEST_JCS) \
+    X(CONNECT_FB) X(OUT_Q1) X(OUT_Q2) X(SET_HALT) X(DRIVE_FLAG_H)
+    
+    constexpr const auto signal_names = []
+    {
+        auto names = std::array<const char*, 64>{};
+        
+#define NAME(s) names[std::countr_zero(static_cast<µcode_type>(s))] = #s;
+        SIGNALS(NAME)
+#undef NAME
+        
+        return names;
+    }();
+#undef SIGNALS
+    
+    // a table file as it was burned, either a bare table of this board's geometry or a write_rom_image() file describing itself
+    class rom_view
+    {
+    public:
+        rom_view(void) noexcept = default;
+        
+        rom_view(const rom_view&) = delete;
+        rom_view& operator=(const rom_view&) = delete;
+        
+        ~rom_view(void) noexcept
+        {
+            if (mapping)
+            {
+                ::munmap(mapping, size);
+            }
+        }
+        
+        const std::uint8_t* bytes = nullptr;
+        std::size_t width = µcode_line_width, rows = 0x100, word_size = sizeof(µcode_type);
+        std::uint8_t layout = 0;
+        trap_encoding encoding = trap_encoding::opcode_bit;
+        
+        // a bare table takes its layout and encoding from the caller
+        bool open(const char* path, std::uint8_t bare_layout, trap_encoding bare_encoding) noexcept
+        {
+            const auto fd = mapping ? -1 : ::open(path, O_RDONLY);
+            
+            if (fd < 0)
+            {
+                return false;
+            }
+            
+            struct stat info{};
+            size = (::fstat(fd, &info) == 0) ? static_cast<std::size_t>(info.st_size) : 0;
+            
+            const auto mapped = size ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+            
+            ::close(fd);
+            
+            if (mapped == MAP_FAILED)
+            {
+                return false;
+            }
+            
+            mapping = mapped;
+            
+            const auto& header = *static_cast<const rom_header*>(mapped);
+            
+            if (size >= sizeof(rom_header) && header.magic == rom_magic)
+            {
+                width = header.width;
+                rows = header.rows;
+                layout = header.layout;
+                encoding = static_cast<trap_encoding>(header.encoding);
+                word_size = (layout == vertical_layout::id) ? sizeof(vertical_layout::word_type) : sizeof(µcode_type);
+                bytes = static_cast<const std::uint8_t*>(mapped) + sizeof(rom_header);
+                
+                return header.version == rom_version && size == sizeof(rom_header) + rows * line_size();
+            }
+            
+            layout = bare_layout;
+            encoding = bare_encoding;
+            word_size = (layout == vertical_layout::id) ? sizeof(vertical_layout::word_type) : sizeof(µcode_type);
+            bytes = static_cast<const std::uint8_t*>(mapped);
+            
+            return size == rows * line_size();
+        }
+        
+        std::size_t line_size(void) const noexcept
+        {
+            return width * word_size;
+        }
+        
+        const std::uint8_t* line(std::size_t row) const noexcept
+        {
+            return bytes + row * line_size();
+        }
+        
+        // the stored word, zero-extended
+        µcode_type word(std::size_t row, std::size_t step) const noexcept
+        {
+            auto µop = µcode_type{ 0 };
+            std::memcpy(&µop, line(row) + step * word_size, word_size);
+            
+            return µop;
+        }
+        
+        // back to this board's signals; the first board uses other bit assignments and vertical words go through the
+        // field decoders, explored layouts share these
+        µcode_type decode(µcode_type µop) const noexcept
+        {
+            if (layout == legacy_layout::id) return legacy_layout::decode(µop);
+            if (layout == vertical_layout::id) return vertical_layout::expand(static_cast<vertical_layout::word_type>(µop));
+            
+            return µop;
+        }
+    
+    private:
+        void* mapping = nullptr;
+        std::size_t size = 0;
+    };
+    
+    inline const char* layout_name(std::uint8_t layout) noexcept
+    {
+        return (layout == current_layout::id) ? "current" : (layout == legacy_layout::id) ? "legacy" : (layout == vertical_layout::id) ? "vertical" : "explored";
+    }
+    
+    inline void print_row_name(std::size_t row, trap_encoding encoding) noexcept
+    {
+        const auto opcode = static_cast<unsigned int>(row & 0xFF);
+        const auto trap = is_trap_row(opcode, encoding);
+        const auto name = mnemonic(row_opcode(opcode, encoding));
+        
+        if (opcode == ROW_RESET) std::fprintf(stdout, "reset row");
+        else if (opcode == ROW_IRQ) std::fprintf(stdout, "interrupt row");
+        else std::fprintf(stdout, "%s%s (%02X)", trap ? "TRAP " : "", name, opcode);
+        
+        // flag-addressed sequencers hold one variant of each row per C/Z combination
+        if (row > 0xFF)
+        {
+            std::fprintf(stdout, " with%s%s", (row & (std::size_t{ FLAG_C } << 8)) ? " C" : "", (row & (std::size_t{ FLAG_Z } << 8)) ? " Z" : "");
+        }
+    }
+    
+    inline void print_signals(µcode_type µop) noexcept
+    {
+        if (µop == 0)
+        {
+            std::fprintf(stdout, "(empty)");
+            return;
+        }
+        
+        auto separator = "";
+        
+        if (µop & LEN(3))
+        {
+            std::fprintf(stdout, "LEN(%u)", static_cast<unsigned int>(µop >> 62));
+            separator = " ";
+        }
+        
+        for (auto bits = µop & ~LEN(3); bits; bits &= bits - 1, separator = " ")
+        {
+            const auto name = signal_names[std::countr_zero(bits)];
+            
+            if (name) std::fprintf(stdout, "%s%s", separator, name);
+            else std::fprintf(stdout, "%sBIT(%d)", separator, std::countr_zero(bits));
+        }
+    }
+    
+    // signals in from but not in to, each with the given prefix
+    inline void print_delta(µcode_type from, µcode_type to, char prefix) noexcept
+    {
+        for (auto bits = (from & ~to) & ~LEN(3); bits; bits &= bits - 1)
+        {
+            const auto name = signal_names[std::countr_zero(bits)];
+            
+            if (name) std::fprintf(stdout, " %c%s", prefix, name);
+            else std::fprintf(stdout, " %cBIT(%d)", prefix, std::countr_zero(bits));
+        }
+    }
+    
+    inline int run_disasm(const char* path, std::uint8_t bare_layout, trap_encoding bare_encoding) noexcept
+    {
+        auto rom = rom_view{};
+        
+        if (!rom.open(path, bare_layout, bare_encoding))
+        {
+            std::fprintf(stderr, "[Error] File %s is not a microcode table\nExiting...\n", path);
+            return EXIT_FAILURE;
+        }
+        
+        std::fprintf(stdout, "[Table] %s: %s layout, %zu rows of %zu steps\n", path, layout_name(rom.layout), rom.rows, rom.width);
+        
+        for (auto row = std::size_t{ 0 }; row < rom.rows; ++row)
+        {
+            const auto line = rom.line(row);
+            
+            if (std::all_of(line, line + rom.line_size(), [](std::uint8_t byte) { return byte == 0; }))
+            {
+                continue;
+            }
+            
+            print_row_name(row, rom.encoding);
+            std::fprintf(stdout, "\n");
+            
+            for (auto step = std::size_t{ 0 }; step < rom.width && rom.word(row, step); ++step)
+            {
+                std::fprintf(stdout, "    %2zu: ", step);
+                print_signals(rom.decode(rom.word(row, step)));
+                std::fprintf(stdout, "\n");
+            }
+        }
+        
+        return EXIT_SUCCESS;
+    }
+    
+    // what each vertical field's codes select, for wiring the decoders on the board
+    inline void print_field_decoders(void) noexcept
+    {
+        std::fprintf(stdout, "[Fields] %zu-bit words, code 0 of every field selects nothing\n", vertical_bytes * 8);
+        
+        for (auto f = std::size_t{ 0 }; f < vertical_fields.size(); ++f)
+        {
+            const auto& field = vertical_fields[f];
+            const auto low = vertical_slots[f].byte * 8 + vertical_slots[f].shift;
+            
+            std::fprintf(stdout, "    bits %2zu-%2zu  %s\n", low, low + field.bits() - 1, field.name);
+            
+            for (auto code = std::size_t{ 0 }; code < field.count; ++code)
+            {
+                std::fprintf(stdout, "        %2zu: ", code + 1);
+                print_signals(field.values[code]);
+                std::fprintf(stdout, "\n");
+            }
+        }
+    }
+    
+    // lines of the same layout are compared as raw words, XOR-reduced a line at a time, and only differing ones are decoded;
+    // exits with failure when the tables differ, like diff
+    inline int run_rom_diff(const char* path_a, const char* path_b, std::uint8_t bare_layout, trap_encoding bare_encoding) noexcept
+    {
+        auto a = rom_view{}, b = rom_view{};
+        
+        for (const auto& [rom, path] : { std::pair{ &a, path_a }, std::pair{ &b, path_b } })
+        {
+            if (!rom->open(path, bare_layout, bare_encoding))
+            {
+                std::fprintf(stderr, "[Error] File %s is not a microcode table\nExiting...\n", path);
+                return EXIT_FAILURE;
+            }
+        }
+        
+        if (a.width != b.width || a.rows != b.rows)
+        {
+            std::fprintf(stderr, "[Error] Tables of %zux%zu and %zux%zu steps cannot be compared\nExiting...\n", a.rows, a.width, b.rows, b.width);
+            return EXIT_FAILURE;
+        }
+        
+        const auto same_layout = (a.layout == b.layout);
+        
+        auto decoded_a = std::vector<µcode_type>(a.width), decoded_b = std::vector<µcode_type>(b.width);
+        auto flips = std::array<std::uint64_t, 64>{};
+        auto rows = std::size_t{ 0 }, words = std::size_t{ 0 };
+        
+        for (auto row = std::size_t{ 0 }; row < a.rows; ++row)
+        {
+            if (same_layout)
+            {
+                const auto line_a = reinterpret_cast<const std::uint64_t*>(a.line(row)), line_b = reinterpret_cast<const std::uint64_t*>(b.line(row));
+                auto difference = std::uint64_t{ 0 };
+                
+                for (auto i = std::size_t{ 0 }; i < a.line_size() / sizeof(std::uint64_t); ++i)
+                {
+                    difference |= line_a[i] ^ line_b[i];
+                }
+                
+                if (difference == 0)
+                {
+                    continue;
+                }
+            }
+            
+            for (auto step = std::size_t{ 0 }; step < a.width; ++step)
+            {
+                decoded_a[step] = a.decode(a.word(row, step));
+                decoded_b[step] = b.decode(b.word(row, step));
+            }
+            
+            if (decoded_a == decoded_b)
+            {
+                continue;
+            }
+            
+            ++rows;
+            print_row_name(row, a.encoding);
+            
+            if (a.encoding != b.encoding)
+            {
+                std::fprintf(stdout, " / ");
+                print_row_name(row, b.encoding);
+            }
+            
+            std::fprintf(stdout, "\n");
+            
+            for (auto step = std::size_t{ 0 }; step < a.width; ++step)
+            {
+                const auto from = decoded_a[step], to = decoded_b[step];
+                
+                if (from == to)
+                {
+                    continue;
+                }
+                
+                ++words;
+                
+                for (auto bits = (from ^ to) & ~LEN(3); bits; bits &= bits - 1)
+                {
+                    ++flips[std::countr_zero(bits)];
+                }
+                
+                std::fprintf(stdout, "    %2zu:", step);
+                print_delta(from, to, '-');
+                print_delta(to, from, '+');
+                
+                if ((from ^ to) & LEN(3))
+                {
+                    std::fprintf(stdout, " LEN(%u)->LEN(%u)", static_cast<unsigned int>(from >> 62), static_cast<unsigned int>(to >> 62));
+                }
+                std::fprintf(stdout, "\n        was ");
+                print_signals(from);
+                std::fprintf(stdout, "\n        now ");
+                print_signals(to);
+                std::fprintf(stdout, "\n");
+            }
+        }
+        
+        std::fprintf(stdout, "[Diff] %s (%s) vs %s (%s): %zu of %zu rows and %zu words differ\n",
+                     path_a, layout_name(a.layout), path_b, layout_name(b.layout), rows, a.rows, words);
+        
+        for (auto bit = 0u; bit < flips.size(); ++bit)
+        {
+            if (flips[bit])
+            {
+                std::fprintf(stdout, "    %-12s flipped in %llu words\n", signal_names[bit] ? signal_names[bit] : "?", static_cast<unsigned long long>(flips[bit]));
+            }
+        }
+        
+        return rows ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+}
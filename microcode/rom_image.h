@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <array>
+#include <fstream>
+#include <memory>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "microcode.h"
+
+namespace
+{
+    // an image file is this header followed by the layout's table words in row order, the checksum covers the words only
+    struct rom_header
+    {
+        std::array<char, 4> magic;
+        std::uint32_t version;
+        std::uint8_t encoding, layout;
+        std::uint16_t width;
+        std::uint32_t rows;
+        std::uint64_t checksum;
+    };
+    
+    static_assert(sizeof(rom_header) % alignof(µcode_type) == 0, "the words following the header must stay aligned in a mapping");
+    
+    constexpr const auto rom_magic = std::array<char, 4>{ 'M', 'C', 'R', 'M' };
+    constexpr const auto rom_version = std::uint32_t{ 1 };
+    
+    // FNV-1a taken a whole word at a time, folded so the upper bits of a word reach the lower bits of the hash
+    template<typename table>
+    constexpr std::uint64_t rom_checksum(const table& µcode) noexcept
+    {
+        auto hash = std::uint64_t{ 0xCBF29CE484222325 };
+        
+        for (const auto& µinsn : µcode)
+        {
+            for (const auto µop : µinsn)
+            {
+                hash = (hash ^ µop) * 0x100000001B3;
+                hash ^= hash >> 32;
+            }
+        }
+        
+        return hash;
+    }
+    
+    template<trap_encoding encoding, typename layout>
+    constexpr const auto rom_image_header = rom_header
+    {
+        rom_magic, rom_version, static_cast<std::uint8_t>(encoding), layout::id,
+        static_cast<std::uint16_t>(layout::width), static_cast<std::uint32_t>(layout::rows), rom_checksum(encoded_µcode<encoding, layout>),
+    };
+    
+    template<trap_encoding encoding, typename layout>
+    bool write_rom_image(const char* path) noexcept
+    {
+        static constexpr auto& header = rom_image_header<encoding, layout>;
+        static constexpr auto& µcode = encoded_µcode<encoding, layout>;
+        
+        auto file = std::ofstream(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(µcode.data()), sizeof(µcode));
+        
+        return file.good();
+    }
+    
+    // maps an image written by write_rom_image() read-only, after checking it was generated for this encoding and layout;
+    // this board's words are executed straight from the mapping, other layouts are decoded into a private copy
+    template<trap_encoding encoding, typename layout>
+    class mapped_rom
+    {
+    public:
+        mapped_rom(void) noexcept = default;
+        
+        mapped_rom(const mapped_rom&) = delete;
+        mapped_rom& operator=(const mapped_rom&) = delete;
+        
+        ~mapped_rom(void) noexcept
+        {
+            if (mapping)
+            {
+                ::munmap(mapping, sizeof(rom_header) + sizeof(layout_table<layout>));
+            }
+        }
+        
+        // fails without a mapping if the file is missing, truncated, for another board or corrupt
+        bool open(const char* path) noexcept
+        {
+            static constexpr auto size = sizeof(rom_header) + sizeof(layout_table<layout>);
+            static constexpr auto& expected = rom_image_header<encoding, layout>;
+            
+            const auto fd = mapping ? -1 : ::open(path, O_RDONLY);
+            
+            if (fd < 0)
+            {
+                return false;
+            }
+            
+            struct stat info{};
+            const auto mapped = (::fstat(fd, &info) == 0 && static_cast<std::size_t>(info.st_size) == size) ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+            
+            ::close(fd);
+            
+            if (mapped == MAP_FAILED)
+            {
+                return false;
+            }
+            
+            const auto& header = *static_cast<const rom_header*>(mapped);
+            const auto& µcode = *reinterpret_cast<const layout_table<layout>*>(static_cast<const std::uint8_t*>(mapped) + sizeof(rom_header));
+            
+            if (header.magic != expected.magic || header.version != expected.version || header.encoding != expected.encoding ||
+                header.layout != expected.layout || header.width != expected.width || header.rows != expected.rows || header.checksum != rom_checksum(µcode))
+            {
+                ::munmap(mapped, size);
+                return false;
+            }
+            
+            mapping = mapped;
+            checksum = header.checksum;
+            
+            if constexpr (std::is_same_v<layout, current_layout>)
+            {
+                words = &µcode;
+            }
+            
+            else
+            {
+                decoded = std::make_unique<layout_table<layout>>(µcode);
+                
+                for (auto& µinsn : *decoded)
+                {
+                    for (auto& µop : µinsn)
+                    {
+                        µop = layout::decode(µop);
+                    }
+                }
+                
+                words = decoded.get();
+            }
+            
+            return true;
+        }
+        
+        const layout_table<layout>& table(void) const noexcept
+        {
+            return *words;
+        }
+        
+        // the image holds the same table this binary was built with
+        bool built_in(void) const noexcept
+        {
+            return checksum == rom_image_header<encoding, layout>.checksum;
+        }
+    
+    private:
+        void* mapping = nullptr;
+        std::uint64_t checksum = 0;
+        
+        const layout_table<layout>* words = nullptr;
+        std::unique_ptr<layout_table<layout>> decoded{};
+    };
+}
@@ -0,0 +1,478 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <algorithm>
+
+#include <array>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "microcode.h"
+#include "legacy_layout.h"
+#include "devices.h"
+#include "banks.h"
+
+namespace
+{
+    struct machine_state
+    {
+        std::uint8_t a = 0, b = 0, c = 0, d = 0, f = 0;
+        std::uint8_t ir = 0, q1 = 0, q2 = 0;
+        std::uint8_t ir_flags = 0; //C and Z at the last fetch, only on flag-addressed sequencers
+        std::uint8_t bank = 0; //upper address byte of ACU-addressed loads and stores, only in the mode_flag encoding
+        bool acu_stack = false; //the ACU was loaded from SP, stack-relative accesses stay in the flat space like the stack
+        std::uint8_t alu_a = 0, alu_b = 0;
+        std::uint8_t alu_out = 0, alu_flags = 0; //result latch, only on layouts with latched_alu
+        
+        std::uint16_t pc = 0, sp = 0;
+        std::uint16_t acu = 0, adu = 0;
+        std::uint16_t mar = 0; //last address driven, only without a separate address bus
+        
+        std::uint8_t step = 0;
+        bool halted = false, step_mode = false;
+        bool irq = false, int_enable = false;
+        
+        std::uint32_t counter_hold = 0; //upper bytes of the last counter read, CNT_OH drains them low byte first
+        std::uint64_t cycles = 0, retired = 0; //also the guest-visible counters, which only show their low 32 bits
+    };
+    
+    // periodic external request line, e.g. a timer tick or a UART receive strobe
+    struct interrupt_source
+    {
+        std::uint64_t period, next;
+    };
+    
+    struct interrupt_stats
+    {
+        std::uint64_t taken = 0, latency_total = 0, latency_max = 0;
+        std::uint64_t latency_min = std::numeric_limits<std::uint64_t>::max();
+        std::uint64_t raised_at = 0, serviced_at = 0; //raise time of the pending and of the serviced request
+    };
+    
+    // the table a simulator for this encoding and layout executes, decoded back to this board's signals at compile time
+    template<trap_encoding encoding = trap_encoding::opcode_bit, typename layout = current_layout>
+    constexpr const auto decoded_µcode = []
+    {
+        auto µcode = encoded_µcode<encoding, layout>;
+        
+        for (auto& µinsn : µcode)
+        {
+            for (auto& µop : µinsn)
+            {
+                µop = layout::decode(µop);
+            }
+        }
+        
+        return µcode;
+    }();
+    
+    struct alu_output
+    {
+        std::uint8_t result, flags;
+    };
+    
+    // the combinational ALU, also evaluated lane by lane when every ALU row is swept
+    constexpr alu_output alu_function(µcode_type µop, unsigned int a, unsigned int b, unsigned int carry) noexcept
+    {
+        auto wide = 0u;
+        
+        if      (µop & ALU_ADD) wide = a + b + carry;
+        else if (µop & ALU_SUB) wide = a - b - carry;
+        else if (µop & ALU_AND) wide = a & b;
+        else if (µop & ALU_OR)  wide = a | b;
+        else if (µop & ALU_NOT) wide = ~a & 0xFF;
+        else if (µop & ALU_SHL) wide = ((a << (b & 7)) | (a >> (8 - (b & 7)))) & 0xFF;
+        else if (µop & ALU_SHR) wide = ((a >> (b & 7)) | (a << (8 - (b & 7)))) & 0xFF;
+        
+        const auto result = static_cast<std::uint8_t>(wide);
+        const auto flags = static_cast<std::uint8_t>(((wide & 0x100) ? FLAG_C : 0) | (result ? 0 : FLAG_Z));
+        
+        return { result, flags };
+    }
+    
+    // cycle-level model of the datapath, driven directly by the control words from write_µcode()
+    template<trap_encoding encoding = trap_encoding::opcode_bit, typename layout = current_layout>
+    class simulator
+    {
+    public:
+        struct bus_cycle
+        {
+            std::uint16_t address;
+            std::uint8_t data;
+        };
+        
+        static_assert(encoding == trap_encoding::opcode_bit || !layout::fetch_overlap,
+                      "an overlapped fetch moves the PC step past the row end, where mode_flag halts and takes interrupts");
+        
+        explicit simulator(const layout_table<layout>& µcode) noexcept
+            : µcode(µcode)
+        {
+            reset();
+        }
+        
+        simulator(const simulator&) = delete;
+        simulator& operator=(const simulator&) = delete;
+        
+        machine_state state{};
+        std::array<std::uint8_t, 0x10000> memory{};
+        
+        // every page is RAM backed by memory until a ROM or device is mapped over it
+        memory_map map{ memory.data() };
+        
+        // banks past 0 are plain RAM, devices only exist in the flat space
+        bank_memory banks{ memory.data() };
+        
+        interrupt_stats irq_stats{};
+        
+        bus_cycle bus{}; //what the datapath drove on the address and data buses in the last cycle
+        
+        // cycles spent on each control word, bus occupancy is derived from the words afterwards;
+        // only allocated and counted once profiling is asked for
+        std::unique_ptr<std::array<std::array<std::uint64_t, layout::width>, layout::rows>> step_counts{};
+        
+        void enable_profile(void) noexcept
+        {
+            step_counts = std::make_unique<std::array<std::array<std::uint64_t, layout::width>, layout::rows>>();
+        }
+        
+        const layout_table<layout>& table(void) const noexcept
+        {
+            return µcode;
+        }
+        
+        void add_source(std::uint64_t period) noexcept
+        {
+            sources.push_back({ period, state.cycles + period });
+            next_request = std::min(next_request, state.cycles + period);
+        }
+        
+        // executes one microinstruction step, returns false once the machine is halted
+        bool clock(void) noexcept
+        {
+            if (state.halted)
+            {
+                return false;
+            }
+            
+            if constexpr (has_interrupts<layout>)
+            {
+                if (state.cycles >= next_request)
+                {
+                    raise_sources();
+                }
+            }
+            
+            const auto µop = word();
+            
+            if (step_counts)
+            {
+                ++(*step_counts)[row()][state.step];
+            }
+            
+            execute(µop);
+            
+            ++state.cycles;
+            
+            // the sequencer returns to the fetch step on the first empty control word
+            if (++state.step == layout::width || µcode[row()][state.step] == 0)
+            {
+                state.step = 0;
+                state.retired += (state.ir != ROW_IRQ && state.ir != ROW_RESET);
+                
+                if constexpr (encoding == trap_encoding::mode_flag)
+                {
+                    if (state.step_mode) state.halted = true;
+                }
+                
+                if constexpr (has_interrupts<layout>)
+                {
+                    if (state.ir == ROW_IRQ)
+                    {
+                        const auto latency = state.cycles - irq_stats.serviced_at;
+                        
+                        irq_stats.latency_total += latency;
+                        irq_stats.latency_min = std::min(irq_stats.latency_min, latency);
+                        irq_stats.latency_max = std::max(irq_stats.latency_max, latency);
+                    }
+                    
+                    // requests are only sampled between instructions
+                    else if (state.irq && state.int_enable)
+                    {
+                        state.irq = false;
+                        irq_stats.serviced_at = irq_stats.raised_at;
+                        state.ir = ROW_IRQ;
+                        state.step = layout::fetch_steps;
+                        
+                        ++irq_stats.taken;
+                    }
+                }
+            }
+            
+            return !state.halted;
+        }
+        
+        // runs until the machine halts or the cycle budget is spent, returns the cycles executed
+        std::uint64_t run(std::uint64_t budget) noexcept
+        {
+            const auto start = state.cycles;
+            
+            while (budget-- && clock());
+            
+            return state.cycles - start;
+        }
+        
+        // the control word the sequencer presents on the next clock
+        µcode_type word(void) const noexcept
+        {
+            return expand_word<layout>(µcode[row()][state.step]);
+        }
+        
+        std::size_t row(void) const noexcept
+        {
+            return layout::flag_addressed ? (state.ir | (state.ir_flags << 8)) : state.ir;
+        }
+        
+        // one control word applied to the datapath, leaving the sequencer and the cycle count alone
+        void execute(µcode_type µop) noexcept
+        {
+            const auto length = static_cast<std::uint16_t>(µop >> 62);
+            
+            // conditions see F as it stood before the step, like every other register read in it
+            const auto f = state.f;
+            
+            // sources
+            auto address = std::uint16_t{ 0 };
+            
+            // an overlapped fetch addresses through the PC incrementer
+            if (µop & PC_OE) address |= (layout::fetch_overlap && (µop & PC_INI)) ? static_cast<std::uint16_t>(state.pc + length) : state.pc;
+            if (µop & ACU_OE) address |= state.acu;
+            if (µop & LSU_SP_EN) address |= state.sp;
+            
+            // with one shared bus the address is driven a step ahead and held for the data transfer
+            if constexpr (!layout::separate_address_bus)
+            {
+                if (µop & (PC_OE | ACU_OE | LSU_SP_EN)) state.mar = address;
+                else address = state.mar;
+            }
+            
+            const auto [result, flags] = alu(µop);
+            const auto alu_out = layout::latched_alu ? alu_output{ state.alu_out, state.alu_flags } : alu_output{ result, flags };
+            
+            // the first board has a single register for both address units
+            auto& adu = layout::shared_address_unit ? state.acu : state.adu;
+            
+            auto data = std::uint8_t{ 0 };
+            
+            if (µop & RF_AO) data |= state.a;
+            if (µop & RF_BO) data |= state.b;
+            if (µop & RF_CO) data |= state.c;
+            if (µop & RF_DO) data |= state.d;
+            if ((µop & RF_FO) && (µop & CONNECT_FB)) data |= state.f;
+            
+            if (µop & ALU_OE) data |= alu_out.result;
+            if (µop & OUT_Q1) data |= state.q1;
+            if (µop & OUT_Q2) data |= state.q2;
+            if (µop & ADU_RL) data |= static_cast<std::uint8_t>(adu);
+            if (µop & ADU_RH) data |= static_cast<std::uint8_t>(adu >> 8);
+            
+            if constexpr (layout::halt_sets_flags)
+            {
+                if (µop & DRIVE_FLAG_H) data |= FLAG_H;
+            }
+            
+            // counters read as they stood before this cycle
+            const auto counter = static_cast<std::uint32_t>((µop & CNT_SEL) ? state.retired : state.cycles);
+            
+            if constexpr (encoding == trap_encoding::mode_flag)
+            {
+                if (µop & CNT_OL) data |= static_cast<std::uint8_t>(counter);
+                if (µop & CNT_OH) data |= static_cast<std::uint8_t>(state.counter_hold);
+            }
+            
+            // data accesses through the ACU leave the flat space once a bank is selected
+            const auto banked = (encoding == trap_encoding::mode_flag) && (µop & ACU_OE) && state.bank && !state.acu_stack;
+            
+            if (µop & LSU_RE) data |= banked ? banks.bank(state.bank)[address] : load(address);
+            
+            // sinks
+            if (µop & RF_AI) state.a = data;
+            if (µop & RF_BI) state.b = data;
+            if (µop & RF_CI) state.c = data;
+            if (µop & RF_DI) state.d = data;
+            if (µop & RF_FI) state.f = (µop & CONNECT_FB) ? data : static_cast<std::uint8_t>((state.f & ~(FLAG_C | FLAG_Z)) | alu_out.flags);
+            
+            if (µop & ALU_WA) state.alu_a = data;
+            if (µop & ALU_WB) state.alu_b = data;
+            
+            if constexpr (layout::latched_alu)
+            {
+                if (µop & ALU_HOLD)
+                {
+                    state.alu_out = result;
+                    state.alu_flags = flags;
+                }
+            }
+            
+            if (µop & LSU_WE)
+            {
+                if (banked) banks.bank(state.bank)[address] = data;
+                else store(address, data);
+            }
+            
+            if (µop & IR_WE)
+            {
+                state.ir = data;
+                state.ir_flags = state.f & (FLAG_C | FLAG_Z);
+                state.q1 = peek(static_cast<std::uint16_t>(address + 1));
+                state.q2 = peek(static_cast<std::uint16_t>(address + 2));
+            }
+            
+            if (µop & ACU_WL) state.acu = static_cast<std::uint16_t>((state.acu & 0xFF00) | data);
+            if (µop & ACU_WH) state.acu = static_cast<std::uint16_t>((state.acu & 0x00FF) | (data << 8));
+            if (µop & ACU_INC) ++state.acu;
+            if (µop & ACU_DEC) --state.acu;
+            
+            if constexpr (encoding == trap_encoding::mode_flag)
+            {
+                if (µop & (ACU_WL | ACU_WH)) state.acu_stack = false;
+                if (µop & ACU_LD) state.acu = address, state.acu_stack = true;
+                if (µop & ACU_ADD) state.acu += data;
+            }
+            
+            if (µop & ADU_WE) adu = address;
+            
+            if (µop & LSU_SP_WE) state.sp += (µop & LSU_SP_D) ? -1 : 1;
+            if (µop & LSU_SP_LD) state.sp = address;
+            
+            if (µop & PC_INI) state.pc += length;
+            
+            if (µop & PC_LRC)
+            {
+                const auto taken = (µop & FORCE_JUMP) ||
+                                   ((µop & REQUEST_JEZ) && (f & FLAG_Z)) ||
+                                   ((µop & REQUEST_JCS) && (f & FLAG_C));
+                
+                state.pc = taken ? address : static_cast<std::uint16_t>(state.pc + length);
+            }
+            
+            if constexpr (encoding == trap_encoding::mode_flag)
+            {
+                if (µop & SET_STEP) state.step_mode = true;
+                if (µop & CLR_STEP) state.step_mode = false;
+                
+                if (µop & ACU_BANK) state.bank = data;
+                
+                if (µop & CNT_OH) state.counter_hold >>= 8;
+                if (µop & CNT_OL) state.counter_hold = counter >> 8;
+            }
+            
+            if constexpr (has_interrupts<layout>)
+            {
+                if (µop & PC_VEC) state.pc = IRQ_VECTOR;
+                if (µop & INT_EI) state.int_enable = true;
+                if (µop & INT_DI) state.int_enable = false;
+            }
+            
+            if (µop & SET_HALT) state.halted = true;
+            
+            bus = { address, data };
+        }
+        
+        void resume(void) noexcept
+        {
+            state.halted = false;
+        }
+        
+        // the reset line only forces the sequencer into its reset row, the microcode initialises the rest
+        void reset(void) noexcept
+        {
+            if constexpr (layout::has_reset_row)
+            {
+                state.ir = ROW_RESET;
+                state.step = layout::fetch_steps;
+            }
+            
+            // without a reset row the registers are cleared in hardware and the sequencer starts on a fetch
+            else
+            {
+                state.pc = state.sp = 0;
+                state.f = 0;
+                state.ir = NOP;
+                state.step = 0;
+            }
+            
+            state.halted = false;
+        }
+    
+    private:
+        const layout_table<layout>& µcode;
+        
+        std::vector<interrupt_source> sources{};
+        std::uint64_t next_request = std::numeric_limits<std::uint64_t>::max();
+        
+        void raise_sources(void) noexcept
+        {
+            if (!state.irq)
+            {
+                state.irq = true;
+                irq_stats.raised_at = state.cycles;
+            }
+            
+            next_request = std::numeric_limits<std::uint64_t>::max();
+            
+            for (auto& source : sources)
+            {
+                // device wait states can step the clock past a request
+                while (source.next <= state.cycles)
+                {
+                    source.next += source.period;
+                }
+                
+                next_request = std::min(next_request, source.next);
+            }
+        }
+        
+        // RAM and ROM pages are served straight from host memory, only device pages pay for a dispatch
+        std::uint8_t load(std::uint16_t address) noexcept
+        {
+            const auto& page = map.pages[address >> 8];
+            
+            if (page.read)
+            {
+                return page.read[address & 0xFF];
+            }
+            
+            state.cycles += page.latency;
+            return map.read(address, state.cycles);
+        }
+        
+        void store(std::uint16_t address, std::uint8_t data) noexcept
+        {
+            const auto& page = map.pages[address >> 8];
+            
+            if (page.write)
+            {
+                page.write[address & 0xFF] = data;
+                return;
+            }
+            
+            state.cycles += page.latency;
+            map.write(address, data, state.cycles);
+        }
+        
+        // operand prefetch must not disturb device registers, so devices read as an idle bus
+        std::uint8_t peek(std::uint16_t address) const noexcept
+        {
+            const auto& page = map.pages[address >> 8];
+            return page.read ? page.read[address & 0xFF] : 0;
+        }
+        
+        alu_output alu(µcode_type µop) const noexcept
+        {
+            return alu_function(µop, state.alu_a, state.alu_b, (state.f & FLAG_C) ? 1 : 0);
+        }
+    };
+}
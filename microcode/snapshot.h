@@ -0,0 +1,266 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <array>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "microcode.h"
+#include "simulator.h"
+#include "devices.h"
+
+namespace
+{
+    using page_bitmap = std::array<std::uint8_t, 0x100 / 8>; //one bit per 256-byte page of a 64 KB bank
+    
+    // a snapshot is this header followed by every 256-byte page of the flat space that is not all zero, in address order,
+    // then a bank_header and the pages of every other bank that was touched, then a device_header and the UART's queues;
+    // the raw machine_state ties it to the build that wrote it, which is all a warm checkpoint needs
+    struct snapshot_header
+    {
+        std::array<char, 4> magic;
+        std::uint32_t version;
+        std::uint8_t encoding, layout;
+        
+        machine_state state;
+        page_bitmap present;
+        std::uint16_t banks;
+    };
+    
+    struct bank_header
+    {
+        std::uint8_t index;
+        page_bitmap present;
+    };
+    
+    // what the devices hold between accesses; the page kinds tie it to the --rom/--uart/--timer/--gpio map it was taken under,
+    // the received bytes and the arriving messages follow it
+    struct device_header
+    {
+        std::array<device, 0x100> kinds;
+        
+        std::uint64_t transmitted, overruns;
+        std::uint32_t received, arriving;
+        
+        std::uint64_t timer_start;
+        std::uint8_t prescaler, high;
+        
+        std::uint8_t output, input;
+        std::uint64_t writes;
+        
+        std::uint64_t stalls, rom_writes;
+    };
+    
+    constexpr const auto snapshot_magic = std::array<char, 4>{ 'M', 'C', 'S', 'N' };
+    constexpr const auto snapshot_version = std::uint32_t{ 6 };
+    
+    constexpr const auto page_size = std::size_t{ 0x100 };
+    
+    inline page_bitmap present_pages(const std::uint8_t* bank) noexcept
+    {
+        auto present = page_bitmap{};
+        
+        for (auto page = std::size_t{ 0 }; page < 0x100; ++page)
+        {
+            const auto begin = bank + page * page_size;
+            
+            if (std::any_of(begin, begin + page_size, [](std::uint8_t byte) { return byte != 0; }))
+            {
+                present[page / 8] |= static_cast<std::uint8_t>(1 << (page % 8));
+            }
+        }
+        
+        return present;
+    }
+    
+    inline void write_pages(std::ofstream& file, const std::uint8_t* bank, const page_bitmap& present) noexcept
+    {
+        for (auto page = std::size_t{ 0 }; page < 0x100; ++page)
+        {
+            if (present[page / 8] & (1 << (page % 8)))
+            {
+                file.write(reinterpret_cast<const char*>(bank + page * page_size), page_size);
+            }
+        }
+    }
+    
+    inline bool read_pages(std::ifstream& file, std::uint8_t* bank, const page_bitmap& present) noexcept
+    {
+        for (auto page = std::size_t{ 0 }; page < 0x100; ++page)
+        {
+            if ((present[page / 8] & (1 << (page % 8))) && !file.read(reinterpret_cast<char*>(bank + page * page_size), page_size))
+            {
+                return false;
+            }
+        }
+        
+        return true;
+    }
+    
+    template<trap_encoding encoding, typename layout>
+    bool save_snapshot(const simulator<encoding, layout>& sim, const char* path) noexcept
+    {
+        auto header = snapshot_header{ snapshot_magic, snapshot_version, static_cast<std::uint8_t>(encoding), layout::id, sim.state, present_pages(sim.memory.data()), 0 };
+        
+        for (auto index = 1u; index < 0x100; ++index)
+        {
+            header.banks += (sim.banks.find(static_cast<std::uint8_t>(index)) != nullptr);
+        }
+        
+        auto file = std::ofstream(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        write_pages(file, sim.memory.data(), header.present);
+        
+        for (auto index = 1u; index < 0x100; ++index)
+        {
+            if (const auto bank = sim.banks.find(static_cast<std::uint8_t>(index)))
+            {
+                const auto far = bank_header{ static_cast<std::uint8_t>(index), present_pages(bank) };
+                
+                file.write(reinterpret_cast<const char*>(&far), sizeof(far));
+                write_pages(file, bank, far.present);
+            }
+        }
+        
+        const auto& map = sim.map;
+        auto devices = device_header{};
+        
+        std::transform(map.pages.begin(), map.pages.end(), devices.kinds.begin(), [](const memory_page& page) { return page.kind; });
+        
+        devices.transmitted = map.uart.transmitted;
+        devices.overruns = map.uart.overruns;
+        devices.received = static_cast<std::uint32_t>(map.uart.received.size());
+        devices.arriving = static_cast<std::uint32_t>(map.uart.arriving.size());
+        devices.timer_start = map.timer.start;
+        devices.prescaler = map.timer.prescaler;
+        devices.high = map.timer.high;
+        devices.output = map.gpio.output;
+        devices.input = map.gpio.input;
+        devices.writes = map.gpio.writes;
+        devices.stalls = map.stalls;
+        devices.rom_writes = map.rom_writes;
+        
+        file.write(reinterpret_cast<const char*>(&devices), sizeof(devices));
+        
+        for (const auto byte : map.uart.received)
+        {
+            file.put(static_cast<char>(byte));
+        }
+        
+        for (const auto& message : map.uart.arriving)
+        {
+            file.write(reinterpret_cast<const char*>(&message.cycle), sizeof(message.cycle));
+            file.put(static_cast<char>(message.byte));
+        }
+        
+        return file.good();
+    }
+    
+    // fails without touching the simulator if the file is not a snapshot of this encoding and layout,
+    // or was taken with devices or a ROM mapped on other pages than the simulator has now
+    template<trap_encoding encoding, typename layout>
+    bool load_snapshot(simulator<encoding, layout>& sim, const char* path) noexcept
+    {
+        auto file = std::ifstream(path, std::ios::binary);
+        auto header = snapshot_header{};
+        
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != snapshot_magic || header.version != snapshot_version ||
+            header.encoding != static_cast<std::uint8_t>(encoding) || header.layout != layout::id)
+        {
+            return false;
+        }
+        
+        auto memory = std::array<std::uint8_t, 0x10000>{};
+        auto banks = std::vector<std::pair<std::uint8_t, std::unique_ptr<bank_memory::bank_type>>>{};
+        
+        if (!read_pages(file, memory.data(), header.present))
+        {
+            return false;
+        }
+        
+        for (auto i = 0u; i < header.banks; ++i)
+        {
+            auto far = bank_header{};
+            auto bank = std::make_unique<bank_memory::bank_type>();
+            
+            if (!file.read(reinterpret_cast<char*>(&far), sizeof(far)) || far.index == 0 || !read_pages(file, bank->data(), far.present))
+            {
+                return false;
+            }
+            
+            banks.emplace_back(far.index, std::move(bank));
+        }
+        
+        auto devices = device_header{};
+        
+        if (!file.read(reinterpret_cast<char*>(&devices), sizeof(devices)) ||
+            !std::equal(devices.kinds.begin(), devices.kinds.end(), sim.map.pages.begin(), [](device kind, const memory_page& page) { return kind == page.kind; }))
+        {
+            return false;
+        }
+        
+        auto received = std::deque<std::uint8_t>{};
+        auto arriving = std::deque<uart_message>{};
+        
+        // element by element, a corrupt count runs into the end of the file rather than into the allocator
+        for (auto i = 0u; i < devices.received; ++i)
+        {
+            auto byte = char{};
+            
+            if (!file.get(byte))
+            {
+                return false;
+            }
+            
+            received.push_back(static_cast<std::uint8_t>(byte));
+        }
+        
+        for (auto i = 0u; i < devices.arriving; ++i)
+        {
+            auto message = uart_message{};
+            auto byte = char{};
+            
+            if (!file.read(reinterpret_cast<char*>(&message.cycle), sizeof(message.cycle)) || !file.get(byte))
+            {
+                return false;
+            }
+            
+            message.byte = static_cast<std::uint8_t>(byte);
+            arriving.push_back(message);
+        }
+        
+        sim.state = header.state;
+        sim.memory = memory;
+        sim.banks.clear();
+        
+        for (const auto& [index, bank] : banks)
+        {
+            std::copy(bank->begin(), bank->end(), sim.banks.bank(index));
+        }
+        
+        auto& map = sim.map;
+        
+        map.uart.transmitted = devices.transmitted;
+        map.uart.overruns = devices.overruns;
+        map.uart.received = std::move(received);
+        map.uart.arriving = std::move(arriving);
+        map.timer.start = devices.timer_start;
+        map.timer.prescaler = devices.prescaler;
+        map.timer.high = devices.high;
+        map.gpio.output = devices.output;
+        map.gpio.input = devices.input;
+        map.gpio.writes = devices.writes;
+        map.stalls = devices.stalls;
+        map.rom_writes = devices.rom_writes;
+        
+        return true;
+    }
+}
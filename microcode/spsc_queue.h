@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <atomic>
+#include <bit>
+#include <optional>
+#include <vector>
+
+namespace
+{
+    // bounded single-producer single-consumer ring; each side owns one index and only reads the other's,
+    // so neither needs a lock or a compare-and-swap
+    template<typename T>
+    class spsc_queue
+    {
+    public:
+        explicit spsc_queue(std::size_t capacity) : slots(std::bit_ceil(capacity)), mask(slots.size() - 1) {}
+        
+        spsc_queue(const spsc_queue&) = delete;
+        spsc_queue& operator=(const spsc_queue&) = delete;
+        
+        // producer side, false when the ring is full
+        bool push(const T& value) noexcept
+        {
+            const auto tail = write.load(std::memory_order_relaxed);
+            
+            if (tail - read.load(std::memory_order_acquire) == slots.size())
+            {
+                return false;
+            }
+            
+            slots[tail & mask] = value;
+            write.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+        
+        // consumer side
+        std::optional<T> front(void) const noexcept
+        {
+            const auto head = read.load(std::memory_order_relaxed);
+            
+            if (head == write.load(std::memory_order_acquire))
+            {
+                return std::nullopt;
+            }
+            
+            return slots[head & mask];
+        }
+        
+        void pop(void) noexcept
+        {
+            read.store(read.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+    
+    private:
+        std::vector<T> slots;
+        std::size_t mask;
+        
+        // on separate cache lines, the producer and the consumer run on different cores
+        alignas(64) std::atomic<std::size_t> write{ 0 };
+        alignas(64) std::atomic<std::size_t> read{ 0 };
+    };
+}
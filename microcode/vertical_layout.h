@@ -0,0 +1,222 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+#include "microcode.h"
+
+namespace
+{
+    // one encoded field of a vertical control word: code n selects values[n - 1], code 0 none of them
+    struct control_field
+    {
+        const char* name;
+        std::array<µcode_type, 15> values;
+        std::size_t count;
+        
+        constexpr µcode_type mask(void) const noexcept
+        {
+            auto mask = µcode_type{ 0 };
+            
+            for (auto i = std::size_t{ 0 }; i < count; ++i)
+            {
+                mask |= values[i];
+            }
+            
+            return mask;
+        }
+        
+        constexpr unsigned int bits(void) const noexcept
+        {
+            return static_cast<unsigned int>(std::bit_width(count));
+        }
+    };
+    
+    template<typename... values>
+    consteval control_field field(const char* name, values... signals) noexcept
+    {
+        return { name, { static_cast<µcode_type>(signals)... }, sizeof...(signals) };
+    }
+    
+    // groups that never drive together anywhere in the table, a value may also be a fixed combination of signals;
+    // PC_CUB is never used and has no code
+    constexpr const auto vertical_fields = std::to_array<control_field>(
+    {
+        field("data source", RF_AO, RF_BO, RF_CO, RF_DO, RF_FO, ALU_OE, OUT_Q1, OUT_Q2, ADU_RL, ADU_RH, LSU_RE, CNT_OL, CNT_OL | CNT_SEL, CNT_OH),
+        field("data sink", RF_AI, RF_BI, RF_CI, RF_DI, ALU_WA, ALU_WB, ACU_WL, ACU_WH, LSU_WE, IR_WE, ACU_BANK),
+        field("ALU operation", ALU_ADD, ALU_SUB, ALU_AND, ALU_OR, ALU_NOT, ALU_SHL, ALU_SHR),
+        field("modes", INT_EI, INT_DI, SET_STEP, CLR_STEP, INT_DI | CLR_STEP),
+        field("length", LEN(1), LEN(2), LEN(3)),
+        field("address source", PC_OE, ACU_OE, LSU_SP_EN),
+        field("jump condition", FORCE_JUMP, REQUEST_JEZ, REQUEST_JCS),
+        field("PC load", PC_INI, PC_LRC, PC_VEC),
+        field("SP update", LSU_SP_WE, LSU_SP_WE | LSU_SP_D, LSU_SP_LD),
+        field("ACU step", ACU_INC, ACU_DEC, ACU_LD | ACU_ADD),
+        field("flags in", RF_FI),
+        field("ADU in", ADU_WE),
+        field("flag bus", CONNECT_FB),
+        field("halt", SET_HALT),
+    });
+    
+    struct field_slot
+    {
+        std::size_t byte;
+        unsigned int shift;
+    };
+    
+    // fields are placed widest first into the first byte with room, so none straddles a byte
+    // and the whole word decodes through one lookup per byte
+    constexpr const auto vertical_slots = []
+    {
+        auto slots = std::array<field_slot, vertical_fields.size()>{};
+        auto used = std::array<unsigned int, 8>{};
+        
+        for (auto bits = 8u; bits > 0; --bits)
+        {
+            for (auto f = std::size_t{ 0 }; f < vertical_fields.size(); ++f)
+            {
+                if (vertical_fields[f].bits() != bits)
+                {
+                    continue;
+                }
+                
+                auto byte = std::size_t{ 0 };
+                while (used[byte] + bits > 8) ++byte;
+                
+                slots[f] = { byte, used[byte] };
+                used[byte] += bits;
+            }
+        }
+        
+        return slots;
+    }();
+    
+    constexpr const auto vertical_bytes = []
+    {
+        auto bytes = std::size_t{ 0 };
+        
+        for (const auto& slot : vertical_slots)
+        {
+            bytes = std::max(bytes, slot.byte + 1);
+        }
+        
+        return bytes;
+    }();
+    
+    static_assert(vertical_bytes <= sizeof(std::uint32_t), "the vertical fields no longer fit a 32-bit word");
+    
+    // the field decoders, per byte of the word the OR of what each of its fields selects
+    constexpr const auto vertical_decoders = []
+    {
+        auto decoders = std::array<std::array<µcode_type, 0x100>, vertical_bytes>{};
+        
+        for (auto byte = std::size_t{ 0 }; byte < vertical_bytes; ++byte)
+        {
+            for (auto code = 0u; code < 0x100; ++code)
+            {
+                for (auto f = std::size_t{ 0 }; f < vertical_fields.size(); ++f)
+                {
+                    const auto& field = vertical_fields[f];
+                    const auto value = (code >> vertical_slots[f].shift) & ((1u << field.bits()) - 1);
+                    
+                    if (vertical_slots[f].byte == byte && value != 0 && value <= field.count)
+                    {
+                        decoders[byte][code] |= field.values[value - 1];
+                    }
+                }
+            }
+        }
+        
+        return decoders;
+    }();
+    
+    // reached during constant evaluation only when a word selects two values of one field or a signal without a code,
+    // which fails the build
+    inline void vertical_fields_cannot_encode_word(void) noexcept
+    {
+    }
+    
+    // this board's signals packed into encoded fields, executed through the field decoders
+    struct vertical_layout
+    {
+        using word_type = std::uint32_t;
+        
+        static constexpr const auto id = std::uint8_t{ 2 };
+        static constexpr const auto unsupported = PC_CUB;
+        static constexpr const auto has_reset_row = true, latched_alu = false, shared_address_unit = false, stack_grows_up = false;
+        static constexpr const auto fetch_overlap = false, separate_address_bus = true, flag_addressed = false, halt_sets_flags = false;
+        
+        static constexpr const auto width = std::size_t{ µcode_line_width }, rows = std::size_t{ 0x100 }, fetch_steps = std::size_t{ 1 };
+        
+        static constexpr word_type pack(µcode_type µop) noexcept
+        {
+            auto word = word_type{ 0 };
+            auto covered = µcode_type{ 0 };
+            
+            for (auto f = std::size_t{ 0 }; f < vertical_fields.size(); ++f)
+            {
+                const auto& field = vertical_fields[f];
+                const auto selected = µop & field.mask();
+                
+                covered |= field.mask();
+                
+                if (selected == 0)
+                {
+                    continue;
+                }
+                
+                auto code = std::size_t{ 0 };
+                while (code < field.count && field.values[code] != selected) ++code;
+                
+                if (code == field.count)
+                {
+                    vertical_fields_cannot_encode_word();
+                }
+                
+                word |= static_cast<word_type>((code + 1) << (vertical_slots[f].byte * 8 + vertical_slots[f].shift));
+            }
+            
+            if (µop & ~covered)
+            {
+                vertical_fields_cannot_encode_word();
+            }
+            
+            return word;
+        }
+        
+        // every line of the table passes through here, so exclusivity is proven for the whole table at compile time
+        static constexpr std::array<word_type, width> translate(const µcode_line& µinsn) noexcept
+        {
+            auto words = std::array<word_type, width>{};
+            
+            for (auto step = std::size_t{ 0 }; step < width; ++step)
+            {
+                words[step] = pack(µinsn[step]);
+            }
+            
+            return words;
+        }
+        
+        // the table stays packed, the sequencer expands each word as it is executed
+        static constexpr word_type decode(word_type word) noexcept
+        {
+            return word;
+        }
+        
+        static constexpr µcode_type expand(word_type word) noexcept
+        {
+            auto µop = µcode_type{ 0 };
+            
+            for (auto byte = std::size_t{ 0 }; byte < vertical_bytes; ++byte)
+            {
+                µop |= vertical_decoders[byte][(word >> (byte * 8)) & 0xFF];
+            }
+            
+            return µop;
+        }
+    };
+}
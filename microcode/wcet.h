@@ -0,0 +1,449 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <optional>
+#include <vector>
+#include <array>
+
+#include "microcode.h"
+
+namespace
+{
+    // the loop headed at this address branches back to its header at most this many times
+    struct loop_bound
+    {
+        std::uint16_t header;
+        std::uint64_t iterations;
+    };
+    
+    // worst-case cycles per function, each instruction weighted by the non-empty steps of its table row;
+    // a call is PUSH_IP immediately followed by JMP_MEM and is assumed to resume after the jump, as
+    // POP_IP lands one byte past the saved address the callee steps it over the JMP before returning
+    template<trap_encoding encoding = trap_encoding::opcode_bit, typename layout = current_layout>
+    class wcet_analyser
+    {
+        static constexpr const auto no_path = std::numeric_limits<std::uint64_t>::max();
+        
+        struct node
+        {
+            std::uint16_t address;
+            std::uint64_t cost;
+            std::vector<std::size_t> next;
+            bool exits; //returns or halts
+        };
+    
+    public:
+        wcet_analyser(const std::array<std::uint8_t, 0x10000>& image, const std::vector<loop_bound>& bounds) noexcept
+            : image(image), bounds(bounds)
+        {
+        }
+        
+        // prints the reason and returns nothing when the bound cannot be established
+        std::optional<std::uint64_t> function(std::uint16_t entry) noexcept
+        {
+            if (const auto known = results.find(entry); known != results.end())
+            {
+                return known->second;
+            }
+            
+            if (std::find(active.begin(), active.end(), entry) != active.end())
+            {
+                std::fprintf(stderr, "[Error] Function %04X is recursive, its stack depth is unbounded\nExiting...\n", entry);
+                return std::nullopt;
+            }
+            
+            active.push_back(entry);
+            
+            auto graph = build(entry);
+            const auto wcet = graph ? solve(*graph, entry) : std::nullopt;
+            
+            active.pop_back();
+            
+            if (wcet)
+            {
+                results[entry] = *wcet;
+            }
+            
+            return wcet;
+        }
+        
+        const std::map<std::uint16_t, std::uint64_t>& functions(void) const noexcept
+        {
+            return results;
+        }
+    
+    private:
+        static constexpr auto& µcode = encoded_µcode<encoding, layout>;
+        static constexpr auto& encoded = encoded_µcode<encoding, current_layout>; //instruction lengths
+        
+        const std::array<std::uint8_t, 0x10000>& image;
+        const std::vector<loop_bound>& bounds;
+        
+        std::map<std::uint16_t, std::uint64_t> results{};
+        std::vector<std::uint16_t> active{}; //call chain being analysed
+        
+        static constexpr unsigned int base(std::uint8_t opcode) noexcept
+        {
+            return row_opcode(opcode, encoding);
+        }
+        
+        static constexpr bool defined(std::uint8_t opcode) noexcept
+        {
+            return encoded[opcode][1] != 0 && opcode != ROW_IRQ && opcode != ROW_RESET;
+        }
+        
+        std::uint16_t operand(std::uint16_t pc) const noexcept
+        {
+            return static_cast<std::uint16_t>(image[static_cast<std::uint16_t>(pc + 1)] | (image[static_cast<std::uint16_t>(pc + 2)] << 8));
+        }
+        
+        // one node per reachable instruction, calls folded into their call site
+        std::optional<std::vector<node>> build(std::uint16_t entry) noexcept
+        {
+            auto nodes = std::vector<node>{};
+            auto index = std::map<std::uint16_t, std::size_t>{};
+            auto targets = std::vector<std::vector<std::uint16_t>>{};
+            auto pending = std::vector<std::uint16_t>{ entry };
+            
+            while (!pending.empty())
+            {
+                const auto pc = pending.back();
+                pending.pop_back();
+                
+                if (index.contains(pc))
+                {
+                    continue;
+                }
+                
+                const auto opcode = image[pc];
+                
+                if (!defined(opcode))
+                {
+                    std::fprintf(stderr, "[Error] Undefined opcode %02X at %04X in function %04X\nExiting...\n", opcode, pc, entry);
+                    return std::nullopt;
+                }
+                
+                auto insn = node{ pc, µcode_steps(µcode[opcode]), {}, false };
+                auto next = std::vector<std::uint16_t>{};
+                const auto fallthrough = static_cast<std::uint16_t>(pc + (encoded[opcode][1] >> 62));
+                
+                switch (base(opcode))
+                {
+                    case JMP_MEM:
+                        next = { operand(pc) };
+                        break;
+                    
+                    case JEZ_MEM: case JCS_MEM:
+                        next = { operand(pc), fallthrough };
+                        break;
+                    
+                    case BRK: case POP_IP: case RETI:
+                        insn.exits = true;
+                        break;
+                    
+                    case PUSH_IP:
+                        if (const auto jump = image[fallthrough]; defined(jump) && base(jump) == JMP_MEM)
+                        {
+                            const auto callee = function(operand(fallthrough));
+                            
+                            if (!callee)
+                            {
+                                return std::nullopt;
+                            }
+                            
+                            insn.cost += µcode_steps(µcode[jump]) + *callee;
+                            next = { static_cast<std::uint16_t>(fallthrough + 3) };
+                            break;
+                        }
+                        
+                        [[fallthrough]];
+                    
+                    default:
+                        next = { fallthrough };
+                        break;
+                }
+                
+                index[pc] = nodes.size();
+                nodes.push_back(insn);
+                targets.push_back(next);
+                pending.insert(pending.end(), next.begin(), next.end());
+            }
+            
+            for (auto i = std::size_t{ 0 }; i < nodes.size(); ++i)
+            {
+                for (const auto target : targets[i])
+                {
+                    nodes[i].next.push_back(index[target]);
+                }
+            }
+            
+            return nodes;
+        }
+        
+        std::optional<std::uint64_t> solve(std::vector<node>& nodes, std::uint16_t entry) noexcept
+        {
+            const auto count = nodes.size();
+            
+            // reverse postorder from the entry, which build() placed at index 0
+            auto order = std::vector<std::size_t>{}, position = std::vector<std::size_t>(count);
+            {
+                auto visited = std::vector<bool>(count);
+                auto stack = std::vector<std::pair<std::size_t, std::size_t>>{ { 0, 0 } };
+                visited[0] = true;
+                
+                while (!stack.empty())
+                {
+                    auto& [n, edge] = stack.back();
+                    
+                    if (edge < nodes[n].next.size())
+                    {
+                        const auto s = nodes[n].next[edge++];
+                        
+                        if (!visited[s])
+                        {
+                            visited[s] = true;
+                            stack.push_back({ s, 0 });
+                        }
+                    }
+                    
+                    else
+                    {
+                        order.push_back(n);
+                        stack.pop_back();
+                    }
+                }
+                
+                std::reverse(order.begin(), order.end());
+                
+                for (auto i = std::size_t{ 0 }; i < count; ++i)
+                {
+                    position[order[i]] = i;
+                }
+            }
+            
+            auto preds = std::vector<std::vector<std::size_t>>(count);
+            
+            for (auto n = std::size_t{ 0 }; n < count; ++n)
+            {
+                for (const auto s : nodes[n].next)
+                {
+                    preds[s].push_back(n);
+                }
+            }
+            
+            // immediate dominators, Cooper, Harvey and Kennedy
+            auto idom = std::vector<std::size_t>(count, count);
+            idom[0] = 0;
+            
+            const auto intersect = [&](std::size_t a, std::size_t b)
+            {
+                while (a != b)
+                {
+                    while (position[a] > position[b]) a = idom[a];
+                    while (position[b] > position[a]) b = idom[b];
+                }
+                
+                return a;
+            };
+            
+            for (auto changed = true; changed; )
+            {
+                changed = false;
+                
+                for (const auto n : order)
+                {
+                    if (n == 0) continue;
+                    
+                    auto dom = count;
+                    
+                    for (const auto p : preds[n])
+                    {
+                        if (idom[p] != count)
+                        {
+                            dom = (dom == count) ? p : intersect(p, dom);
+                        }
+                    }
+                    
+                    if (idom[n] != dom)
+                    {
+                        idom[n] = dom;
+                        changed = true;
+                    }
+                }
+            }
+            
+            const auto dominates = [&](std::size_t d, std::size_t n)
+            {
+                for (; n != d && n != 0; n = idom[n]);
+                return n == d;
+            };
+            
+            // natural loops, from the back edges into each header
+            auto loops = std::map<std::size_t, std::vector<bool>>{};
+            
+            for (auto n = std::size_t{ 0 }; n < count; ++n)
+            {
+                for (const auto h : nodes[n].next)
+                {
+                    if (position[h] > position[n]) continue;
+                    
+                    if (!dominates(h, n))
+                    {
+                        std::fprintf(stderr, "[Error] Loop entered at %04X has more than one entry in function %04X\nExiting...\n", nodes[h].address, entry);
+                        return std::nullopt;
+                    }
+                    
+                    auto& body = loops.try_emplace(h, count, false).first->second;
+                    auto pending = std::vector<std::size_t>{ n };
+                    body[h] = true;
+                    
+                    while (!pending.empty())
+                    {
+                        const auto m = pending.back();
+                        pending.pop_back();
+                        
+                        if (!body[m])
+                        {
+                            body[m] = true;
+                            pending.insert(pending.end(), preds[m].begin(), preds[m].end());
+                        }
+                    }
+                }
+            }
+            
+            // innermost loops first, each collapsed into its header once bounded
+            auto nested = std::vector<std::pair<std::size_t, std::size_t>>{};
+            
+            for (const auto& [h, body] : loops)
+            {
+                nested.push_back({ static_cast<std::size_t>(std::count(body.begin(), body.end(), true)), h });
+            }
+            
+            std::sort(nested.begin(), nested.end());
+            
+            auto rep = std::vector<std::size_t>(count);
+            auto members = std::vector<std::vector<std::size_t>>(count);
+            
+            for (auto n = std::size_t{ 0 }; n < count; ++n)
+            {
+                rep[n] = n;
+                members[n] = { n };
+            }
+            
+            
+            // longest path over the collapsed graph restricted to `inside`, ending where `done` holds
+            const auto longest = [&](std::size_t from, const auto& inside, const auto& done, std::size_t skip)
+            {
+                auto memo = std::vector<std::uint64_t>(count, no_path);
+                auto seen = std::vector<bool>(count);
+                
+                const auto walk = [&](const auto& self, std::size_t r) -> std::uint64_t
+                {
+                    if (seen[r]) return memo[r];
+                    seen[r] = true;
+                    
+                    auto best = done(r) ? std::uint64_t{ 0 } : no_path;
+                    
+                    for (const auto n : members[r])
+                    {
+                        for (const auto s : nodes[n].next)
+                        {
+                            const auto t = rep[s];
+                            
+                            if (t != r && t != skip && inside(t))
+                            {
+                                if (const auto rest = self(self, t); rest != no_path)
+                                {
+                                    best = (best == no_path) ? rest : std::max(best, rest);
+                                }
+                            }
+                        }
+                    }
+                    
+                    return memo[r] = (best == no_path) ? no_path : best + nodes[r].cost;
+                };
+                
+                return walk(walk, from);
+            };
+            
+            const auto edges_to = [&](std::size_t r, const auto& predicate)
+            {
+                for (const auto n : members[r])
+                {
+                    if (nodes[n].exits && predicate(count)) return true;
+                    
+                    for (const auto s : nodes[n].next)
+                    {
+                        if (predicate(rep[s])) return true;
+                    }
+                }
+                
+                return false;
+            };
+            
+            for (const auto& [size, h] : nested)
+            {
+                const auto& body = loops[h];
+                
+                const auto bound = std::find_if(bounds.begin(), bounds.end(), [&](const loop_bound& b) { return b.header == nodes[h].address; });
+                
+                if (bound == bounds.end())
+                {
+                    std::fprintf(stderr, "[Error] Loop at %04X in function %04X has no bound, pass --bound %04X:<iterations>\nExiting...\n",
+                                 nodes[h].address, entry, nodes[h].address);
+                    return std::nullopt;
+                }
+                
+                const auto inside = [&](std::size_t r) { return r < count && body[r]; };
+                
+                const auto iteration = longest(h, inside, [&](std::size_t r) { return edges_to(r, [&](std::size_t t) { return t == h; }); }, h);
+                const auto leave = longest(h, inside, [&](std::size_t r) { return edges_to(r, [&](std::size_t t) { return !inside(t); }); }, h);
+                
+                if (leave == no_path)
+                {
+                    std::fprintf(stderr, "[Error] Loop at %04X in function %04X never exits\nExiting...\n", nodes[h].address, entry);
+                    return std::nullopt;
+                }
+                
+                auto total = leave;
+                
+                if (iteration != no_path)
+                {
+                    total += bound->iterations * iteration;
+                }
+                
+                for (auto r = std::size_t{ 0 }; r < count; ++r)
+                {
+                    if (body[r] && rep[r] == r && r != h)
+                    {
+                        for (const auto n : members[r])
+                        {
+                            rep[n] = h;
+                        }
+                        
+                        members[h].insert(members[h].end(), members[r].begin(), members[r].end());
+                        members[r].clear();
+                    }
+                }
+                
+                nodes[h].cost = total;
+            }
+            
+            const auto wcet = longest(rep[0], [](std::size_t) { return true; }, [&](std::size_t r) { return edges_to(r, [&](std::size_t t) { return t == count; }); }, count);
+            
+            if (wcet == no_path)
+            {
+                std::fprintf(stderr, "[Error] Function %04X never returns\nExiting...\n", entry);
+                return std::nullopt;
+            }
+            
+            return wcet;
+        }
+    };
+}